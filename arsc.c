@@ -16,8 +16,12 @@ int main(int argc, char **argv)
 	}
 	cmd_name = argv[1];
 
-	if (!strcmp(cmd_name, "dump"))
+	if (!strcmp(cmd_name, "diff"))
+		cmd_func = cmd_diff;
+	else if (!strcmp(cmd_name, "dump"))
 		cmd_func = cmd_dump;
+	else if (!strcmp(cmd_name, "gen"))
+		cmd_func = cmd_gen;
 #ifndef NDEBUG
 	else if (!strcmp(cmd_name, "test"))
 		cmd_func = cmd_test;
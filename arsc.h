@@ -33,6 +33,11 @@ struct arsc_string_pool {
 	} data;
 };
 
+enum {
+	ARSC_STRING_POOL_SORTED = 1 << 0,
+	ARSC_STRING_POOL_UTF8 = 1 << 8,
+};
+
 struct arsc_package {
 	struct arsc_chunk_header header;
 	struct {
@@ -100,6 +105,57 @@ struct arsc_type {
 	} data;
 };
 
+enum {
+	ARSC_TYPE_FLAG_SPARSE = 0x01,
+};
+
+/* sparse types store (entry index, offset / 4) pairs instead of offsets */
+struct arsc_sparse_entry {
+	uint16_t idx;
+	uint16_t offset;
+};
+
+#define ARSC_NO_ENTRY 0xffffffff
+
+struct arsc_entry {
+	uint16_t size;
+	uint16_t flags;
+	uint32_t key;
+};
+
+enum {
+	ARSC_ENTRY_FLAG_COMPLEX = 0x0001,
+	ARSC_ENTRY_FLAG_PUBLIC = 0x0002,
+	ARSC_ENTRY_FLAG_WEAK = 0x0004,
+};
+
+struct arsc_value {
+	uint16_t size;
+	uint8_t res0;
+	uint8_t data_type;
+	uint32_t data;
+};
+
+/*
+ * Complex entries: the entry header is followed by the parent (a resource
+ * id, or 0) and a count of name/value pairs, which start at entry.size.
+ */
+struct arsc_map_entry {
+	struct arsc_entry entry;
+	uint32_t parent;
+	uint32_t count;
+};
+
+struct arsc_map {
+	uint32_t name;
+	struct arsc_value value;
+};
+
+enum {
+	ARSC_VALUE_TYPE_STRING = 0x03,
+	ARSC_VALUE_TYPE_INT_DEC = 0x10,
+};
+
 /*
  * Wrapper structs. These are writeable during parsing, but should be
  * considered read-only afterwards.
@@ -107,8 +163,11 @@ struct arsc_type {
 struct type_spec {
 	const struct arsc_type_spec *spec;
 	const struct arsc_type **types;
+	uint32_t *config_masks; /* config_mask() of each type */
+	uint32_t config_mask; /* union of config_masks */
 	size_t type_count;
-	size_t max_type_count;
+	/* blobs set up from an index: end of the types, NULL once loaded */
+	const void *types_end;
 };
 
 struct package {
@@ -117,13 +176,13 @@ struct package {
 	const struct arsc_string_pool *sp_resource_names;
 	struct type_spec *specs;
 	size_t spec_count;
-	size_t max_spec_count;
 };
 
 struct blob {
 	const struct arsc_header *header;
 	const struct arsc_string_pool *sp_values;
 	struct package *packages;
+	int lazy;
 };
 
 
@@ -1,15 +1,56 @@
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
 #include "arsc.h"
 #include "blob.h"
 #include "common.h"
+#include "config.h"
+#include "error.h"
+
+/*
+ * All wrapper structs of a blob live in a single arena, allocated once
+ * the chunk counts are known:
+ *
+ *   struct blob
+ *   struct package[package_count]
+ *   struct type_spec[spec_count]       (all packages, in blob order)
+ *   const struct arsc_type *[type_count] (all type specs, in blob order)
+ *   uint32_t config_masks[type_count]
+ *
+ * Each package's specs, and each spec's types, are contiguous runs in
+ * these arrays, since types always follow their type spec and type specs
+ * their package.
+ */
+struct chunk_counts {
+	size_t package_count;
+	size_t spec_count;
+	size_t type_count;
+};
 
 /*
  * Information about ongoing parsing of resources.arsc blob.
  */
 struct parser_context {
-	const void *map;
+	const uint8_t *map;
 	size_t map_size;
 	size_t offset;
+	struct error *err;
 
+	/* arena slots, and how many of them have been handed out */
+	struct package *packages;
+	struct type_spec *specs;
+	const struct arsc_type **types;
+	uint32_t *config_masks;
+	size_t used_specs;
+	size_t used_types;
+
+	/* chunk order state; see check_order */
+	int seen_header;
+	int seen_values;
+	int seen_spec; /* in the current package */
+	int package_pools; /* name string pools of the current package */
+	uint32_t package_count;
 	uint32_t next_package;
 	enum {
 		SP_NONE,
@@ -19,159 +60,431 @@ struct parser_context {
 	} next_string_pool;
 };
 
-#define check_alignment(offset, alignment) \
+/*
+ * fail_if: record a parse error at the current offset and make the calling
+ * parse_* function return -1
+ */
+#define fail_if(ctx, cond, fmt, ...) \
 	do { \
-		if (offset % alignment != 0) \
-			die("offset not on %d byte alignment", alignment); \
+		if ((cond)) { \
+			error_set((ctx)->err, ERROR_FORMAT, (ctx)->offset, \
+				  fmt, ##__VA_ARGS__); \
+			return -1; \
+		} \
 	} while (0)
 
 static inline uint16_t peek_uint16(const uint8_t *map, size_t offset)
 {
-	const uint16_t *p;
-	check_alignment(offset, 2);
-	p = (const uint16_t *)(map + offset);
+	const uint16_t *p = (const uint16_t *)(map + offset);
 	return dtohs(*p);
 }
 
-static void parse_string_pool(struct parser_context *ctx, struct blob *blob)
+/*
+ * Check that the offset tables of pool, the string pool at the current
+ * offset, lie within it, and that its strings and styles start behind
+ * them, so that strpool_get only has to check the strings themselves.
+ */
+static int check_string_pool(struct parser_context *ctx,
+			     const struct arsc_string_pool *pool)
+{
+	uint64_t size = dtohl(pool->header.size);
+	uint64_t tables = dtohs(pool->header.header_size) +
+		4 * ((uint64_t)dtohl(pool->data.string_count) +
+		     dtohl(pool->data.style_count));
+
+	fail_if(ctx, tables > size, "string pool offsets exceed pool");
+	fail_if(ctx, dtohl(pool->data.string_count) &&
+		(dtohl(pool->data.strings_start) < tables ||
+		 dtohl(pool->data.strings_start) > size),
+		"bad string pool strings start %u",
+		dtohl(pool->data.strings_start));
+	fail_if(ctx, dtohl(pool->data.style_count) &&
+		(dtohl(pool->data.styles_start) < tables ||
+		 dtohl(pool->data.styles_start) > size),
+		"bad string pool styles start %u",
+		dtohl(pool->data.styles_start));
+	return 0;
+}
+
+/* The chunk at the current offset of a mapped blob */
+static const void *chunk_here(const struct parser_context *ctx)
 {
-	die_if(!blob->sp_values && ctx->next_string_pool != SP_VALUES,
-	       "offset=%zd: unexpected string pool type %d",
-	       ctx->offset, ctx->next_string_pool);
+	return &ctx->map[ctx->offset];
+}
 
+/*
+ * The parse_* functions record the chunk at the current offset, which
+ * check_next has accepted.
+ */
+static void parse_string_pool(struct parser_context *ctx, struct blob *blob)
+{
 	const struct arsc_string_pool *pool =
 		(struct arsc_string_pool *)&ctx->map[ctx->offset];
-	struct package *pkg = NULL;
+	struct package *pkg;
 
-	switch (ctx->next_string_pool) {
-	case SP_VALUES:
+	/* check_order has made sure this is the pool expected next */
+	if (!blob->sp_values) {
 		blob->sp_values = pool;
-		ctx->next_string_pool = SP_NONE;
-		break;
-	case SP_TYPE_NAMES:
-		die_if(ctx->next_package == 0,
-		       "offset=%zd: unexpected type name string pool",
-		       ctx->offset);
-		pkg = &blob->packages[ctx->next_package - 1];
-		die_if(pkg->sp_type_names,
-		       "offset=%zd: unexpected extra type name string pool",
-		       ctx->offset);
+		return;
+	}
+	pkg = &blob->packages[ctx->next_package - 1];
+	if (!pkg->sp_type_names)
 		pkg->sp_type_names = pool;
-		ctx->next_string_pool = SP_RES_NAMES;
-		break;
-	case SP_RES_NAMES:
-		die_if(ctx->next_package == 0,
-		       "offset=%zd: unexpected resource name string pool",
-		       ctx->offset);
-		pkg = &blob->packages[ctx->next_package - 1];
-		die_if(pkg->sp_resource_names,
-		       "offset=%zd: unexpected extra resource name string pool",
-		       ctx->offset);
+	else
 		pkg->sp_resource_names = pool;
-		ctx->next_string_pool = SP_NONE;
-		break;
-	case SP_NONE:
-		die("offset=%zd: did not expect string pool", ctx->offset);
-	}
-	ctx->offset += dtohs(pool->header.size);
 }
 
 static void parse_blob_header(struct parser_context *ctx, struct blob *blob)
 {
-	die_if(blob->header, "offset=%zd: extra blob header", ctx->offset);
-
 	blob->header = (struct arsc_header *)&ctx->map[ctx->offset];
-	blob->packages = xcalloc(dtohl(blob->header->data.package_count),
-				 sizeof(struct package));
-	ctx->next_string_pool = SP_VALUES;
-
-	ctx->offset += dtohs(blob->header->header.header_size);
+	blob->packages = ctx->packages;
 }
 
 static void parse_package(struct parser_context *ctx, struct blob *blob)
 {
-	die_if(!blob->header,
-	       "offset=%zd: package before blob header", ctx->offset);
-	die_if(ctx->next_package >= dtohl(blob->header->data.package_count),
-	       "offset=%zd: unexpected additional package", ctx->offset);
+	struct package *pkg = &blob->packages[ctx->next_package - 1];
 
-	const struct arsc_package *a_pkg =
-		(struct arsc_package *)&ctx->map[ctx->offset];
-	struct package *pkg = &blob->packages[ctx->next_package];
-	pkg->package = a_pkg;
+	pkg->package = (struct arsc_package *)&ctx->map[ctx->offset];
 	pkg->sp_type_names = NULL;
 	pkg->sp_resource_names = NULL;
 	pkg->spec_count = 0;
-	pkg->max_spec_count = 2;
-	pkg->specs = xcalloc(pkg->max_spec_count, sizeof(struct type_spec));
-
-	ctx->next_string_pool = SP_TYPE_NAMES;
-	ctx->next_package++;
-	ctx->offset += dtohs(a_pkg->header.header_size);
+	pkg->specs = &ctx->specs[ctx->used_specs];
 }
 
 static void parse_type(struct parser_context *ctx, struct blob *blob)
 {
-	die_if(ctx->next_package == 0,
-	       "offset=%zd: type found before package", ctx->offset);
 	const struct arsc_type *a_type =
 		(struct arsc_type *)&ctx->map[ctx->offset];
 	struct package *pkg = &blob->packages[ctx->next_package - 1];
-	die_if(pkg->spec_count == 0,
-	       "offset=%zd: type found before type spec", ctx->offset);
 	struct type_spec *spec = &pkg->specs[pkg->spec_count - 1];
+	uint32_t mask = config_mask(&a_type->data.config);
 
-	if (spec->type_count == spec->max_type_count) {
-		spec->max_type_count *= 2;
-		size_t n = spec->max_type_count * sizeof(struct arsc_type *);
-		spec->types = xrealloc(spec->types, n);
-	}
+	spec->config_masks[spec->type_count] = mask;
+	spec->config_mask |= mask;
 	spec->types[spec->type_count++] = a_type;
-
-	ctx->offset += dtohs(a_type->header.size);
+	ctx->used_types++;
 }
 
 static void parse_type_spec(struct parser_context *ctx, struct blob *blob)
 {
-	die_if(ctx->next_package == 0,
-	       "offset=%zd: type spec found before package", ctx->offset);
-	const struct arsc_type_spec *a_spec =
-		(struct arsc_type_spec *)&ctx->map[ctx->offset];
 	struct package *pkg = &blob->packages[ctx->next_package - 1];
-
-	if (pkg->spec_count == pkg->max_spec_count) {
-		pkg->max_spec_count *= 2;
-		size_t n = pkg->max_spec_count * sizeof(struct type_spec);
-		pkg->specs = xrealloc(pkg->specs, n);
-	}
 	struct type_spec *spec = &pkg->specs[pkg->spec_count++];
-	spec->spec = a_spec;
+
+	spec->spec = (struct arsc_type_spec *)&ctx->map[ctx->offset];
 	spec->type_count = 0;
-	spec->max_type_count = 2;
-	spec->types = xcalloc(spec->max_type_count, sizeof(struct arsc_type *));
+	spec->types = &ctx->types[ctx->used_types];
+	spec->config_masks = &ctx->config_masks[ctx->used_types];
+	spec->config_mask = 0;
+	spec->types_end = NULL;
+	ctx->used_specs++;
+}
 
-	ctx->offset += dtohs(a_spec->header.size);
+/*
+ * The smallest header_size of each chunk type the parsers understand, or 0
+ * for unknown types.
+ */
+static size_t chunk_min_header_size(uint16_t type)
+{
+	switch (type) {
+	case 0x0001: /* string pool */
+		return sizeof(struct arsc_string_pool);
+	case 0x0002: /* blob header */
+		return sizeof(struct arsc_header);
+	case 0x0200: /* package */
+		return offsetof(struct arsc_package, data.type_id_offset);
+	case 0x0201: /* type */
+		return offsetof(struct arsc_type, data.config.mcc);
+	case 0x0202: /* type spec */
+		return sizeof(struct arsc_type_spec);
+	default:
+		return 0;
+	}
 }
 
-void blob_init(struct blob **blob_pp, const void *map, size_t map_size)
+/*
+ * Check that header, read at the current offset, describes a chunk within
+ * the blob whose header is at least min_size bytes.
+ */
+static int check_header(struct parser_context *ctx,
+			const struct arsc_chunk_header *header,
+			size_t min_size)
 {
-	struct blob *blob = xmalloc(sizeof(*blob));
-	blob->header = NULL;
-	blob->sp_values = NULL;
-	blob->packages = NULL;
+	fail_if(ctx, dtohs(header->header_size) < min_size ||
+		dtohs(header->header_size) > dtohl(header->size),
+		"bad chunk header size %d", dtohs(header->header_size));
+	fail_if(ctx, dtohl(header->size) > ctx->map_size - ctx->offset,
+		"chunk size %d exceeds blob", dtohl(header->size));
+	return 0;
+}
+
+/*
+ * Check that a chunk header can start at the current offset.
+ */
+static int check_room(struct parser_context *ctx)
+{
+	size_t left = ctx->map_size - ctx->offset;
+
+	fail_if(ctx, ctx->offset % 4 != 0, "chunk not on 4 byte alignment");
+	fail_if(ctx, left < sizeof(struct arsc_chunk_header),
+		"truncated chunk header");
+	return 0;
+}
+
+/*
+ * Check that the chunk at the current offset lies within the blob, so that
+ * the parse_* functions can read its header.
+ */
+static int check_chunk(struct parser_context *ctx, size_t min_size)
+{
+	if (check_room(ctx))
+		return -1;
+	return check_header(ctx, (const struct arsc_chunk_header *)
+			    &ctx->map[ctx->offset], min_size);
+}
+
+/*
+ * Check that header, read at the current offset, is that of a chunk type
+ * the parsers understand, and store the smallest header size of the type,
+ * which the header is known to have, in *min_size.
+ */
+static int check_known(struct parser_context *ctx,
+		       const struct arsc_chunk_header *header,
+		       size_t *min_size)
+{
+	*min_size = chunk_min_header_size(dtohs(header->type));
+	fail_if(ctx, !*min_size, "unknown type 0x%04x",
+		dtohs(header->type));
+	return check_header(ctx, header, *min_size);
+}
+
+/*
+ * How far to move past a chunk: the blob header and packages contain the
+ * chunks that follow them, so only their headers are skipped.
+ */
+static size_t chunk_step(const struct arsc_chunk_header *header)
+{
+	switch (dtohs(header->type)) {
+	case 0x0002: /* blob header */
+	case 0x0200: /* package */
+		return dtohs(header->header_size);
+	default:
+		return dtohl(header->size);
+	}
+}
+
+static int check_package_pools(struct parser_context *ctx)
+{
+	fail_if(ctx, ctx->next_package && ctx->package_pools < 2,
+		"package %d lacks name string pools", ctx->next_package - 1);
+	return 0;
+}
+
+/*
+ * Chunk order: the blob header comes first, and the value string pool
+ * before any other pool. Each package is followed by its type name and
+ * resource name pools, and types by the type spec they belong to. Check
+ * that the chunk at the current offset, whose header has passed
+ * check_known, may come next, and move the order state past it.
+ */
+static int check_order(struct parser_context *ctx,
+		       const struct arsc_chunk_header *header)
+{
+	switch (dtohs(header->type)) {
+	case 0x0001: /* string pool */
+		switch (ctx->next_string_pool) {
+		case SP_VALUES:
+			ctx->seen_values = 1;
+			ctx->next_string_pool = SP_NONE;
+			break;
+		case SP_TYPE_NAMES:
+			fail_if(ctx, !ctx->seen_values,
+				"unexpected string pool type %d",
+				ctx->next_string_pool);
+			ctx->package_pools++;
+			ctx->next_string_pool = SP_RES_NAMES;
+			break;
+		case SP_RES_NAMES:
+			ctx->package_pools++;
+			ctx->next_string_pool = SP_NONE;
+			break;
+		case SP_NONE:
+			fail_if(ctx, 1, "did not expect string pool");
+		}
+		break;
+	case 0x0002: /* blob header */
+		fail_if(ctx, ctx->seen_header, "extra blob header");
+		ctx->seen_header = 1;
+		ctx->package_count = dtohl(((const struct arsc_header *)
+					    header)->data.package_count);
+		ctx->next_string_pool = SP_VALUES;
+		break;
+	case 0x0200: /* package */
+		fail_if(ctx, !ctx->seen_header, "package before blob header");
+		fail_if(ctx, ctx->next_package >= ctx->package_count,
+			"unexpected additional package");
+		if (check_package_pools(ctx))
+			return -1;
+		ctx->next_package++;
+		ctx->package_pools = 0;
+		ctx->seen_spec = 0;
+		ctx->next_string_pool = SP_TYPE_NAMES;
+		break;
+	case 0x0201: /* type */
+		fail_if(ctx, ctx->next_package == 0,
+			"type found before package");
+		fail_if(ctx, !ctx->seen_spec, "type found before type spec");
+		break;
+	case 0x0202: /* type spec */
+		fail_if(ctx, ctx->next_package == 0,
+			"type spec found before package");
+		ctx->seen_spec = 1;
+		break;
+	}
+	return 0;
+}
+
+/*
+ * Check what check_order cannot see until all chunks have been walked.
+ */
+static int check_order_end(struct parser_context *ctx)
+{
+	fail_if(ctx, !ctx->seen_header, "no blob header");
+	fail_if(ctx, !ctx->seen_values, "no value string pool");
+	fail_if(ctx, ctx->next_package != ctx->package_count,
+		"package count %d does not match expected package count %d",
+		ctx->next_package, ctx->package_count);
+	return check_package_pools(ctx);
+}
+
+/*
+ * Check the chunk at the current offset, whose header has passed
+ * check_known, and whose first min_size bytes are at header. This is
+ * everything init and streaming check before they use a chunk, so that
+ * both accept the same blobs.
+ */
+static int check_next(struct parser_context *ctx,
+		      const struct arsc_chunk_header *header)
+{
+	const struct arsc_type *type = (const struct arsc_type *)header;
+
+	switch (dtohs(header->type)) {
+	case 0x0001: /* string pool */
+		if (check_string_pool(ctx,
+				      (const struct arsc_string_pool *)header))
+			return -1;
+		break;
+	case 0x0201: /* type */
+		fail_if(ctx, dtohl(type->data.config.size) >
+			dtohs(type->header.header_size) -
+			offsetof(struct arsc_type, data.config),
+			"type config size %u exceeds type header",
+			dtohl(type->data.config.size));
+		break;
+	}
+	return check_order(ctx, header);
+}
+
+/*
+ * First pass: walk the chunk headers, without interpreting them, to find
+ * out how large the arena must be.
+ */
+static int count_chunks(struct parser_context *ctx,
+			struct chunk_counts *counts)
+{
+	const struct arsc_chunk_header *header;
+
+	counts->package_count = 0;
+	counts->spec_count = 0;
+	counts->type_count = 0;
+
+	while (ctx->offset < ctx->map_size) {
+		if (check_chunk(ctx, sizeof(struct arsc_chunk_header)))
+			return -1;
+		header = (const struct arsc_chunk_header *)
+			&ctx->map[ctx->offset];
+		switch (dtohs(header->type)) {
+		case 0x0200: /* package */
+			counts->package_count++;
+			break;
+		case 0x0201: /* type */
+			counts->type_count++;
+			break;
+		case 0x0202: /* type spec */
+			counts->spec_count++;
+			break;
+		}
+		ctx->offset += chunk_step(header);
+	}
+	ctx->offset = 0;
+	return 0;
+}
+
+static struct blob *alloc_arena(struct parser_context *ctx,
+				const struct chunk_counts *counts)
+{
+	size_t size = sizeof(struct blob) +
+		counts->package_count * sizeof(struct package) +
+		counts->spec_count * sizeof(struct type_spec) +
+		counts->type_count * sizeof(struct arsc_type *) +
+		counts->type_count * sizeof(uint32_t);
+	struct blob *blob = malloc(size);
+
+	if (!blob)
+		return NULL;
+	ctx->packages = (struct package *)(blob + 1);
+	ctx->specs = (struct type_spec *)
+		(ctx->packages + counts->package_count);
+	ctx->types = (const struct arsc_type **)
+		(ctx->specs + counts->spec_count);
+	ctx->config_masks = (uint32_t *)(ctx->types + counts->type_count);
+	ctx->used_specs = 0;
+	ctx->used_types = 0;
+	return blob;
+}
+
+int blob_try_init(struct blob **blob_pp, const void *map, size_t map_size,
+		  struct error *err)
+{
+	struct chunk_counts counts;
+	struct blob *blob;
+	int ret = 0;
 
 	struct parser_context ctx = {
 		.map = map,
 		.map_size = map_size,
 		.offset = 0,
+		.err = err,
 		.next_package = 0,
 		.next_string_pool = SP_NONE,
 	};
 
-	/* parse resource.arsc blob */
+	if (count_chunks(&ctx, &counts))
+		return -1;
+	blob = alloc_arena(&ctx, &counts);
+	if (!blob) {
+		error_set(err, ERROR_NOMEM, 0, "out of memory");
+		return -1;
+	}
+	blob->header = NULL;
+	blob->sp_values = NULL;
+	blob->packages = NULL;
+	blob->lazy = 0;
+
+	/* second pass: parse resource.arsc blob */
 	while (ctx.offset < ctx.map_size) {
-		uint16_t type = peek_uint16(ctx.map, ctx.offset);
-		switch (type) {
+		const struct arsc_chunk_header *header;
+		size_t min_size;
+
+		ret = check_chunk(&ctx, sizeof(struct arsc_chunk_header));
+		if (ret)
+			break;
+		header = (const struct arsc_chunk_header *)
+			&ctx.map[ctx.offset];
+		ret = check_known(&ctx, header, &min_size) ||
+			check_next(&ctx, header);
+		if (ret)
+			break;
+		switch (dtohs(header->type)) {
 		case 0x0001: /* string pool */
 			parse_string_pool(&ctx, blob);
 			break;
@@ -187,37 +500,587 @@ void blob_init(struct blob **blob_pp, const void *map, size_t map_size)
 		case 0x0202: /* type spec */
 			parse_type_spec(&ctx, blob);
 			break;
+		}
+		ctx.offset += chunk_step(header);
+	}
+	if (ret == 0)
+		ret = check_order_end(&ctx);
+
+	if (ret) {
+		/* no types have been loaded yet, so only the arena is owned */
+		free(blob);
+		return -1;
+	}
+	*blob_pp = blob;
+	return 0;
+}
+
+int blob_load_types(const struct blob *blob, struct type_spec *spec,
+		    struct error *err)
+{
+	const uint8_t *base = (const uint8_t *)blob->header;
+	const struct arsc_chunk_header *header;
+	const uint8_t *start, *end, *p;
+	size_t i, count = 0;
+	const struct arsc_type **types = NULL;
+
+	if (!spec->types_end)
+		return 0;
+
+	/* blob_try_init_index only knows where the run of types ends */
+	start = (const uint8_t *)spec->spec + dtohl(spec->spec->header.size);
+	end = spec->types_end;
+	for (p = start; p < end; p += dtohl(header->size)) {
+		header = (const struct arsc_chunk_header *)p;
+		if ((uintptr_t)p % 4 != 0 ||
+		    (size_t)(end - p) <
+		    offsetof(struct arsc_type, data.config.mcc) ||
+		    dtohs(header->type) != 0x0201 ||
+		    dtohs(header->header_size) <
+		    offsetof(struct arsc_type, data.config.mcc) ||
+		    dtohs(header->header_size) > dtohl(header->size) ||
+		    dtohl(header->size) > (size_t)(end - p) ||
+		    dtohl(((const struct arsc_type *)p)->data.config.size) >
+		    dtohs(header->header_size) -
+		    offsetof(struct arsc_type, data.config)) {
+			error_set(err, ERROR_FORMAT, p - base,
+				  "bad type chunk in type spec 0x%02x",
+				  spec->spec->data.id);
+			return -1;
+		}
+		count++;
+	}
+
+	if (count) {
+		types = malloc(count * (sizeof(*spec->types) +
+					sizeof(*spec->config_masks)));
+		if (!types) {
+			error_set(err, ERROR_NOMEM, 0, "out of memory");
+			return -1;
+		}
+	}
+	spec->types = types;
+	spec->config_masks = count ? (uint32_t *)(types + count) : NULL;
+	spec->config_mask = 0;
+	for (i = 0, p = start; i < count; i++) {
+		const struct arsc_type *type = (const struct arsc_type *)p;
+		uint32_t mask = config_mask(&type->data.config);
+
+		spec->types[i] = type;
+		spec->config_masks[i] = mask;
+		spec->config_mask |= mask;
+		p += dtohl(type->header.size);
+	}
+	spec->type_count = count;
+	spec->types_end = NULL;
+	return 0;
+}
+
+/*
+ * Offset index. The index lists the offsets (from the start of the blob)
+ * of the chunks a lazily parsed blob records: the value string pool, and
+ * for each package its chunk, its name string pools and its type specs,
+ * with the end of each type spec's run of type chunks. Offsets make the
+ * index position independent, so it can be stored next to the blob and
+ * reused with another mapping of it. All fields are in device byte order.
+ *
+ *   struct index_header
+ *   struct index_package[package_count]
+ *   struct index_spec[spec_count]      (all packages, in blob order)
+ */
+#define INDEX_MAGIC 0x58495241 /* "ARIX" */
+#define INDEX_VERSION 1
+
+struct index_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t map_size;
+	uint32_t package_count;
+	uint32_t spec_count;
+	uint32_t sp_values;
+};
+
+struct index_package {
+	uint32_t offset;
+	uint32_t sp_type_names;
+	uint32_t sp_resource_names;
+	uint32_t spec_count;
+};
+
+struct index_spec {
+	uint32_t offset;
+	uint32_t types_end;
+};
+
+/*
+ * Walk the chunks of a package, jumping over each by its size, and record
+ * its string pools and type specs. If specs is NULL, only count the specs.
+ */
+static int index_package(struct parser_context *ctx, size_t end,
+			 struct index_package *pkg, struct index_spec *specs,
+			 size_t *spec_count)
+{
+	struct index_spec *spec = NULL;
+	size_t pools = 0;
+	int seen_spec = 0;
+
+	while (ctx->offset < end) {
+		const struct arsc_chunk_header *header;
+
+		if (check_chunk(ctx, sizeof(struct arsc_chunk_header)))
+			return -1;
+		header = (const struct arsc_chunk_header *)
+			&ctx->map[ctx->offset];
+		fail_if(ctx, dtohl(header->size) > end - ctx->offset,
+			"chunk exceeds package");
+		switch (dtohs(header->type)) {
+		case 0x0001: /* string pool */
+			fail_if(ctx, pools == 2, "unexpected string pool");
+			if (check_chunk(ctx, sizeof(struct arsc_string_pool)) ||
+			    check_string_pool(ctx, chunk_here(ctx)))
+				return -1;
+			if (pools++ == 0)
+				pkg->sp_type_names = dtohl(ctx->offset);
+			else
+				pkg->sp_resource_names = dtohl(ctx->offset);
+			break;
+		case 0x0201: /* type */
+			fail_if(ctx, !seen_spec, "type found before type spec");
+			if (spec)
+				spec->types_end = dtohl(ctx->offset +
+							dtohl(header->size));
+			break;
+		case 0x0202: /* type spec */
+			if (check_chunk(ctx, sizeof(struct arsc_type_spec)))
+				return -1;
+			seen_spec = 1;
+			if (specs) {
+				spec = &specs[*spec_count];
+				spec->offset = dtohl(ctx->offset);
+				spec->types_end = dtohl(ctx->offset +
+							dtohl(header->size));
+			}
+			(*spec_count)++;
+			break;
+		default:
+			fail_if(ctx, 1, "unexpected chunk type 0x%04x in package",
+				dtohs(header->type));
+		}
+		ctx->offset += dtohl(header->size);
+	}
+	fail_if(ctx, pools != 2, "package lacks name string pools");
+	return 0;
+}
+
+/*
+ * Walk the top level chunks, jumping over each package as a whole once its
+ * children are indexed. If idx is NULL, only count packages and specs;
+ * otherwise idx must have room for the counts found by the first walk.
+ */
+static int index_walk(struct parser_context *ctx, struct index_header *idx,
+		      struct chunk_counts *counts)
+{
+	struct index_package *packages = NULL;
+	struct index_spec *specs = NULL;
+	int seen_header = 0, seen_values = 0;
+
+	if (idx) {
+		packages = (struct index_package *)(idx + 1);
+		specs = (struct index_spec *)(packages + counts->package_count);
+	}
+	counts->package_count = 0;
+	counts->spec_count = 0;
+	counts->type_count = 0;
+
+	ctx->offset = 0;
+	while (ctx->offset < ctx->map_size) {
+		const struct arsc_chunk_header *header;
+		struct index_package pkg;
+		size_t end;
+
+		if (check_chunk(ctx, sizeof(struct arsc_chunk_header)))
+			return -1;
+		header = (const struct arsc_chunk_header *)
+			&ctx->map[ctx->offset];
+		switch (dtohs(header->type)) {
+		case 0x0002: /* blob header */
+			if (check_chunk(ctx, sizeof(struct arsc_header)))
+				return -1;
+			fail_if(ctx, seen_header, "extra blob header");
+			seen_header = 1;
+			ctx->offset += dtohs(header->header_size);
+			break;
+		case 0x0001: /* string pool */
+			fail_if(ctx, !seen_header || seen_values ||
+				counts->package_count,
+				"unexpected string pool");
+			if (check_chunk(ctx, sizeof(struct arsc_string_pool)) ||
+			    check_string_pool(ctx, chunk_here(ctx)))
+				return -1;
+			seen_values = 1;
+			if (idx)
+				idx->sp_values = dtohl(ctx->offset);
+			ctx->offset += dtohl(header->size);
+			break;
+		case 0x0200: /* package */
+			if (check_chunk(ctx, offsetof(struct arsc_package,
+						      data.type_id_offset)))
+				return -1;
+			fail_if(ctx, !seen_header, "package before blob header");
+			end = ctx->offset + dtohl(header->size);
+			pkg.offset = dtohl(ctx->offset);
+			pkg.spec_count = counts->spec_count;
+			ctx->offset += dtohs(header->header_size);
+			if (index_package(ctx, end, &pkg, specs,
+					  &counts->spec_count))
+				return -1;
+			pkg.spec_count = dtohl(counts->spec_count -
+					       pkg.spec_count);
+			if (packages)
+				packages[counts->package_count] = pkg;
+			counts->package_count++;
+			break;
 		default:
-			die("unknown type 0x%04x", type);
+			fail_if(ctx, 1, "unknown type 0x%04x",
+				dtohs(header->type));
 		}
 	}
+	fail_if(ctx, !seen_header, "no blob header");
+	fail_if(ctx, !seen_values, "no value string pool");
+	return 0;
+}
+
+int blob_index_build(const void *map, size_t map_size, void **index_pp,
+		     size_t *index_size, struct error *err)
+{
+	struct chunk_counts counts;
+	struct index_header *idx;
+	size_t size;
 
-	/* check invariants */
-	die_if(ctx.offset != ctx.map_size,
-	       "offset=%zd, blob size=%zd: parsing did not end at end of blob",
-	       ctx.offset, ctx.map_size);
-	die_if(ctx.next_package != dtohl(blob->header->data.package_count),
-	       "package count %d does not match expected package count %d",
-	       ctx.next_package, dtohl(blob->header->data.package_count));
+	struct parser_context ctx = {
+		.map = map,
+		.map_size = map_size,
+		.err = err,
+	};
+
+	if (map_size > UINT32_MAX) {
+		error_set(err, ERROR_UNSUPPORTED, 0, "blob too large to index");
+		return -1;
+	}
+	if (index_walk(&ctx, NULL, &counts))
+		return -1;
+	size = sizeof(*idx) +
+		counts.package_count * sizeof(struct index_package) +
+		counts.spec_count * sizeof(struct index_spec);
+	idx = malloc(size);
+	if (!idx) {
+		error_set(err, ERROR_NOMEM, 0, "out of memory");
+		return -1;
+	}
+	if (index_walk(&ctx, idx, &counts)) {
+		free(idx);
+		return -1;
+	}
+	idx->magic = dtohl(INDEX_MAGIC);
+	idx->version = dtohl(INDEX_VERSION);
+	idx->map_size = dtohl(map_size);
+	idx->package_count = dtohl(counts.package_count);
+	idx->spec_count = dtohl(counts.spec_count);
+	*index_pp = idx;
+	*index_size = size;
+	return 0;
+}
+
+/*
+ * Check that offset names a chunk of the given type within the blob.
+ * Only the chunk header, and for string pools their offset tables, is
+ * inspected; anything behind it is validated when it is used.
+ */
+static int index_check(struct parser_context *ctx, uint32_t offset,
+		       uint16_t type, size_t min_size)
+{
+	ctx->offset = dtohl(offset);
+	fail_if(ctx, ctx->offset >= ctx->map_size, "index offset out of range");
+	if (check_chunk(ctx, min_size))
+		return -1;
+	fail_if(ctx, peek_uint16(ctx->map, ctx->offset) != type,
+		"index does not match blob: expected chunk type 0x%04x", type);
+	if (type == 0x0001)
+		return check_string_pool(ctx, chunk_here(ctx));
+	return 0;
+}
 
+int blob_try_init_index(struct blob **blob_pp, const void *map,
+			size_t map_size, const void *index, size_t index_size,
+			struct error *err)
+{
+	const struct index_header *idx = index;
+	const struct index_package *packages;
+	const struct index_spec *specs;
+	struct chunk_counts counts;
+	struct blob *blob;
+	size_t i, j, spec = 0;
+
+	struct parser_context ctx = {
+		.map = map,
+		.map_size = map_size,
+		.err = err,
+	};
+
+	if (index_size < sizeof(*idx) ||
+	    dtohl(idx->magic) != INDEX_MAGIC ||
+	    dtohl(idx->version) != INDEX_VERSION) {
+		error_set(err, ERROR_FORMAT, 0, "bad index header");
+		return -1;
+	}
+	counts.package_count = dtohl(idx->package_count);
+	counts.spec_count = dtohl(idx->spec_count);
+	counts.type_count = 0;
+	if (dtohl(idx->map_size) != map_size ||
+	    counts.package_count > index_size / sizeof(*packages) ||
+	    counts.spec_count > index_size / sizeof(*specs) ||
+	    index_size != sizeof(*idx) +
+	    counts.package_count * sizeof(*packages) +
+	    counts.spec_count * sizeof(*specs)) {
+		error_set(err, ERROR_FORMAT, 0, "index does not match blob");
+		return -1;
+	}
+	packages = (const struct index_package *)(idx + 1);
+	specs = (const struct index_spec *)(packages + counts.package_count);
+
+	blob = alloc_arena(&ctx, &counts);
+	if (!blob) {
+		error_set(err, ERROR_NOMEM, 0, "out of memory");
+		return -1;
+	}
+	blob->header = (const struct arsc_header *)map;
+	blob->packages = ctx.packages;
+	blob->lazy = 1;
+	if (index_check(&ctx, 0, 0x0002, sizeof(struct arsc_header)) ||
+	    index_check(&ctx, idx->sp_values, 0x0001,
+			sizeof(struct arsc_string_pool)))
+		goto fail;
+	blob->sp_values = (const struct arsc_string_pool *)
+		&ctx.map[ctx.offset];
+	if (dtohl(blob->header->data.package_count) != counts.package_count) {
+		error_set(err, ERROR_FORMAT, 0, "index does not match blob");
+		goto fail;
+	}
+
+	for (i = 0; i < counts.package_count; i++) {
+		const struct index_package *ip = &packages[i];
+		struct package *pkg = &blob->packages[i];
+		size_t n = dtohl(ip->spec_count);
+
+		if (n > counts.spec_count - spec) {
+			error_set(err, ERROR_FORMAT, 0,
+				  "index does not match blob");
+			goto fail;
+		}
+		if (index_check(&ctx, ip->offset, 0x0200,
+				offsetof(struct arsc_package,
+					 data.type_id_offset)))
+			goto fail;
+		pkg->package = (const struct arsc_package *)
+			&ctx.map[ctx.offset];
+		if (index_check(&ctx, ip->sp_type_names, 0x0001,
+				sizeof(struct arsc_string_pool)))
+			goto fail;
+		pkg->sp_type_names = (const struct arsc_string_pool *)
+			&ctx.map[ctx.offset];
+		if (index_check(&ctx, ip->sp_resource_names, 0x0001,
+				sizeof(struct arsc_string_pool)))
+			goto fail;
+		pkg->sp_resource_names = (const struct arsc_string_pool *)
+			&ctx.map[ctx.offset];
+		pkg->specs = &ctx.specs[spec];
+		pkg->spec_count = n;
+
+		for (j = 0; j < n; j++, spec++) {
+			const struct index_spec *is = &specs[spec];
+			struct type_spec *ts = &pkg->specs[j];
+			size_t end = dtohl(is->types_end);
+
+			if (index_check(&ctx, is->offset, 0x0202,
+					sizeof(struct arsc_type_spec)))
+				goto fail;
+			ts->spec = (const struct arsc_type_spec *)
+				&ctx.map[ctx.offset];
+			if (end < ctx.offset + dtohl(ts->spec->header.size) ||
+			    end > map_size) {
+				error_set(err, ERROR_FORMAT, ctx.offset,
+					  "index does not match blob");
+				goto fail;
+			}
+			ts->types = NULL;
+			ts->config_masks = NULL;
+			ts->config_mask = 0;
+			ts->type_count = 0;
+			ts->types_end = &ctx.map[end];
+		}
+	}
+	if (spec != counts.spec_count) {
+		error_set(err, ERROR_FORMAT, 0, "index does not match blob");
+		goto fail;
+	}
 	*blob_pp = blob;
+	return 0;
+
+fail:
+	free(blob);
+	return -1;
 }
 
-void blob_destroy(struct blob *blob)
+/*
+ * Streaming. The chunks are walked in the same order, and checked by the
+ * same functions, as in init, but read with pread instead of from a
+ * mapping: chunk headers into the stack, and type chunks, one at a time,
+ * into a buffer that is reused for the next one. Everything else is
+ * skipped.
+ */
+struct stream_context {
+	struct parser_context ctx;
+	int fd;
+	off_t base;
+	uint8_t *buf;
+	size_t buf_size;
+};
+
+static int stream_read(struct stream_context *sc, void *buf, size_t len)
 {
-	uint32_t i;
+	struct parser_context *ctx = &sc->ctx;
+	size_t done = 0;
+	ssize_t n;
+
+	while (done < len) {
+		n = pread(sc->fd, (uint8_t *)buf + done, len - done,
+			  sc->base + (off_t)(ctx->offset + done));
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0) {
+			error_set(ctx->err, ERROR_IO, ctx->offset, "pread");
+			return -1;
+		}
+		fail_if(ctx, n == 0, "unexpected end of file");
+		done += n;
+	}
+	return 0;
+}
 
-	for (i = 0; i < dtohl(blob->header->data.package_count); i++) {
-		const struct package *pkg = &blob->packages[i];
-		size_t j;
+/*
+ * Read the type chunk of size bytes at the current offset into sc->buf.
+ */
+static int stream_read_type(struct stream_context *sc, size_t size)
+{
+	if (size > sc->buf_size) {
+		uint8_t *p = realloc(sc->buf, size);
+
+		if (!p) {
+			error_set(sc->ctx.err, ERROR_NOMEM, sc->ctx.offset,
+				  "out of memory");
+			return -1;
+		}
+		sc->buf = p;
+		sc->buf_size = size;
+	}
+	return stream_read(sc, sc->buf, size);
+}
+
+/* Room for the header of any chunk type check_known accepts */
+union chunk_header_buf {
+	struct arsc_chunk_header header;
+	struct arsc_string_pool pool;
+	struct arsc_header blob;
+	struct arsc_package package;
+	struct arsc_type type;
+	struct arsc_type_spec spec;
+};
+
+static int stream(struct stream_context *sc, blob_stream_fn fn, void *data)
+{
+	struct parser_context *ctx = &sc->ctx;
+	struct arsc_package package;
+	struct arsc_type_spec spec;
+	struct blob_stream_chunk chunk = { &package, &spec, NULL, 0 };
+
+	while (ctx->offset < ctx->map_size) {
+		union chunk_header_buf h;
+		size_t min_size, len;
+
+		if (check_room(ctx) ||
+		    stream_read(sc, &h.header, sizeof(h.header)) ||
+		    check_known(ctx, &h.header, &min_size))
+			return -1;
+		/* older packages lack the trailing header fields */
+		len = dtohs(h.header.header_size);
+		if (len > sizeof(h))
+			len = sizeof(h);
+		memset((uint8_t *)&h + len, 0, sizeof(h) - len);
+		if (stream_read(sc, &h, len) || check_next(ctx, &h.header))
+			return -1;
+
+		switch (dtohs(h.header.type)) {
+		case 0x0200: /* package */
+			package = h.package;
+			break;
+		case 0x0201: /* type */
+			if (stream_read_type(sc, dtohl(h.header.size)))
+				return -1;
+			chunk.type = (const struct arsc_type *)sc->buf;
+			chunk.offset = ctx->offset;
+			if (fn(&chunk, data))
+				return 0;
+			break;
+		case 0x0202: /* type spec */
+			spec = h.spec;
+			break;
+		}
+		ctx->offset += chunk_step(&h.header);
+	}
+	return check_order_end(ctx);
+}
+
+int blob_stream(int fd, off_t offset, size_t size, blob_stream_fn fn,
+		void *data, struct error *err)
+{
+	struct stream_context sc = {
+		.ctx = {
+			.map_size = size,
+			.err = err,
+		},
+		.fd = fd,
+		.base = offset,
+	};
+	int ret = stream(&sc, fn, data);
+
+	free(sc.buf);
+	return ret;
+}
+
+void blob_init(struct blob **blob_pp, const void *map, size_t map_size)
+{
+	struct error err;
+
+	if (blob_try_init(blob_pp, map, map_size, &err))
+		die("offset=%zd: %s", err.offset, err.message);
+}
+
+void blob_destroy(struct blob *blob)
+{
+	/*
+	 * Everything lives in the arena starting at blob, except for the
+	 * type arrays of lazily parsed blobs.
+	 */
+	if (blob->lazy) {
+		uint32_t n = dtohl(blob->header->data.package_count);
 
-		for (j = 0; j < pkg->spec_count; j++) {
-			const struct type_spec *spec = &pkg->specs[j];
+		for (uint32_t i = 0; i < n; i++) {
+			const struct package *pkg = &blob->packages[i];
 
-			free(spec->types);
+			for (size_t j = 0; j < pkg->spec_count; j++)
+				if (!pkg->specs[j].types_end)
+					free(pkg->specs[j].types);
 		}
-		free(pkg->specs);
 	}
-	free(blob->packages);
 	free(blob);
 }
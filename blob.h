@@ -3,8 +3,84 @@
 #include <unistd.h>
 
 struct blob;
+struct arsc_package;
+struct arsc_type;
+struct arsc_type_spec;
+struct error;
+struct type_spec;
 
 void blob_init(struct blob **blob, const void *map, size_t size);
 void blob_destroy(struct blob *blob);
 
+/*
+ * Like blob_init, but return -1 and fill in err instead of terminating the
+ * program if the blob cannot be parsed. Nothing needs to be cleaned up
+ * after a failure.
+ */
+int blob_try_init(struct blob **blob, const void *map, size_t size,
+		  struct error *err);
+
+/*
+ * Build an offset index of the blob: the chunk offsets that
+ * blob_try_init_index needs to set up a lazily parsed blob without walking
+ * the chunks again. Packages and type specs are jumped over by their chunk
+ * size. The index is a position independent buffer of *index_size bytes,
+ * suitable for storing next to the blob; free it with free().
+ */
+int blob_index_build(const void *map, size_t size, void **index,
+		     size_t *index_size, struct error *err);
+
+/*
+ * Like blob_try_init, but take the chunk offsets from an index built by
+ * blob_index_build for the same blob, and only record the packages and
+ * type specs: the types of a type spec are collected the first time
+ * blob_load_types is called for it. Only the chunk headers the index
+ * points to are checked here; the type chunks of a type spec are validated
+ * when blob_load_types loads them. A lazily parsed blob like this must not
+ * be shared between threads.
+ */
+int blob_try_init_index(struct blob **blob, const void *map, size_t size,
+			const void *index, size_t index_size,
+			struct error *err);
+
+/*
+ * Make spec->types, spec->config_masks, spec->config_mask and
+ * spec->type_count valid for a type spec of blob. Does nothing if they
+ * already are, in particular for blobs parsed by blob_try_init. Return -1
+ * and fill in err if the type chunks are malformed or cannot be recorded;
+ * the spec is then left unloaded.
+ */
+int blob_load_types(const struct blob *blob, struct type_spec *spec,
+		    struct error *err);
+
+/*
+ * A type chunk found by blob_stream, with the headers of the package and
+ * type spec it belongs to. Only the type chunk is read in full; package
+ * and spec point at copies of their chunk headers. All three are only
+ * valid during the callback. offset is that of type within the blob.
+ */
+struct blob_stream_chunk {
+	const struct arsc_package *package;
+	const struct arsc_type_spec *spec;
+	const struct arsc_type *type;
+	size_t offset;
+};
+
+/*
+ * Return non-zero to stop the walk early.
+ */
+typedef int (*blob_stream_fn)(const struct blob_stream_chunk *chunk,
+			      void *data);
+
+/*
+ * Walk the size bytes blob at offset in fd without mapping it, and call fn
+ * for each type chunk, in blob order. The chunks are read with pread, and
+ * checked as by blob_try_init; string pools are skipped, so only the
+ * largest type chunk is ever held in memory, whatever the size of the
+ * blob. Return 0 once the walk is done or fn stopped it, or -1 and fill in
+ * err.
+ */
+int blob_stream(int fd, off_t offset, size_t size, blob_stream_fn fn,
+		void *data, struct error *err);
+
 #endif
@@ -0,0 +1,305 @@
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <zlib.h>
+
+#include "blob.h"
+#include "cache.h"
+#include "common.h"
+#include "error.h"
+#include "filemap.h"
+#include "names.h"
+
+/*
+ * Cache file layout, in host byte order:
+ *
+ *   struct cache_header
+ *   blob index  (at index_offset)
+ *   names       (at names_offset; names_size is 0 if not stored)
+ *
+ * Both parts start on an 8 byte boundary. The key fields are repeated in
+ * the header, so a file name collision is detected as a miss. A CRC-32 of
+ * the index catches a corrupted index; the larger names part is only
+ * checked for consistency by names_load, so that a hit costs no more than
+ * the lookups it serves.
+ */
+#define CACHE_MAGIC 0x43435241 /* "ARCC" */
+#define CACHE_VERSION 2
+
+struct cache_key {
+	uint64_t file_size;
+	int64_t mtime_sec;
+	int64_t mtime_nsec;
+	/* of the zip entry, of sampled pages of a file, or of a buffer */
+	uint32_t crc32;
+	uint32_t data_size;
+};
+
+struct cache_header {
+	uint32_t magic;
+	uint32_t version;
+	struct cache_key key;
+	uint32_t index_offset;
+	uint32_t index_size;
+	uint32_t names_offset;
+	uint32_t names_size;
+	uint32_t index_crc32;
+	uint32_t reserved;
+};
+
+#define ALIGN8(n) (((n) + 7) & ~(size_t)7)
+
+#define SAMPLE_SIZE 4096
+#define SAMPLE_COUNT 16
+
+static uLong crc_range(uLong crc, const uint8_t *p, size_t size)
+{
+	while (size > 0) {
+		uInt n = size > (1u << 30) ? (1u << 30) : size;
+
+		crc = crc32(crc, p, n);
+		p += n;
+		size -= n;
+	}
+	return crc;
+}
+
+/*
+ * CRC-32 of the first and last page of data and of pages spread evenly in
+ * between. Size and mtime already identify a file, so this only needs to
+ * catch files rewritten within the mtime granularity, which nearly always
+ * changes the header chunks.
+ */
+static uLong crc_sampled(const uint8_t *data, size_t size)
+{
+	uLong crc = crc32(0, Z_NULL, 0);
+	size_t stride, i;
+
+	if (size <= SAMPLE_SIZE * (SAMPLE_COUNT + 2))
+		return crc_range(crc, data, size);
+	stride = (size - SAMPLE_SIZE) / (SAMPLE_COUNT + 1);
+	for (i = 0; i <= SAMPLE_COUNT; i++)
+		crc = crc32(crc, data + i * stride, SAMPLE_SIZE);
+	return crc32(crc, data + size - SAMPLE_SIZE, SAMPLE_SIZE);
+}
+
+static int make_key(const struct mapped_file *file, struct cache_key *key,
+		    struct error *err)
+{
+	struct stat st;
+
+	if (file->data_size > UINT32_MAX) {
+		error_set(err, ERROR_UNSUPPORTED, 0, "blob too large to cache");
+		return -1;
+	}
+
+	/* buffers have no mtime; a CRC-32 of all data identifies them */
+	memset(key, 0, sizeof(*key));
+	if (file->fd >= 0) {
+		if (fstat(file->fd, &st) < 0) {
+			error_set(err, ERROR_IO, 0, "stat");
+			return -1;
+		}
+		key->file_size = st.st_size;
+		key->mtime_sec = st.st_mtim.tv_sec;
+		key->mtime_nsec = st.st_mtim.tv_nsec;
+	} else {
+		key->file_size = file->map_size;
+	}
+	key->data_size = file->data_size;
+	if (file->has_crc32)
+		key->crc32 = file->crc32;
+	else if (file->fd >= 0)
+		key->crc32 = crc_sampled(file->data, file->data_size);
+	else
+		key->crc32 = crc_range(crc32(0, Z_NULL, 0), file->data,
+				       file->data_size);
+	return 0;
+}
+
+static void cache_path(const char *dir, const struct cache_key *key,
+		       char *buf, size_t size)
+{
+	const uint8_t *p = (const uint8_t *)key;
+	uint64_t h = 14695981039346656037ull;
+	size_t i;
+
+	for (i = 0; i < sizeof(*key); i++) {
+		h ^= p[i];
+		h *= 1099511628211ull;
+	}
+	snprintf(buf, size, "%s/%016" PRIx64 ".cache", dir, h);
+}
+
+/*
+ * Map the cache file at path and set up cb from it. Return -1 on a miss:
+ * no file, or one that does not match the key or the blob.
+ */
+static int load(const char *path, const struct cache_key *key,
+		const struct mapped_file *file, int want_names,
+		struct cached_blob *cb)
+{
+	const struct cache_header *header;
+	struct error err;
+	struct stat st;
+	void *map;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -1;
+	if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(*header)) {
+		close(fd);
+		return -1;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return -1;
+
+	header = map;
+	if (header->magic != CACHE_MAGIC || header->version != CACHE_VERSION ||
+	    memcmp(&header->key, key, sizeof(*key)) ||
+	    header->index_offset % 8 || header->names_offset % 8 ||
+	    header->index_offset > st.st_size ||
+	    header->index_size > st.st_size - header->index_offset ||
+	    header->names_offset > st.st_size ||
+	    header->names_size > st.st_size - header->names_offset ||
+	    (want_names && !header->names_size) ||
+	    crc32(0, (const Bytef *)map + header->index_offset,
+		  header->index_size) != header->index_crc32)
+		goto miss;
+
+	if (blob_try_init_index(&cb->blob, file->data, file->data_size,
+				(const uint8_t *)map + header->index_offset,
+				header->index_size, &err))
+		goto miss;
+	cb->names = NULL;
+	if (want_names) {
+		cb->names = names_load(cb->blob, (const uint8_t *)map +
+				       header->names_offset,
+				       header->names_size);
+		if (!cb->names) {
+			blob_destroy(cb->blob);
+			goto miss;
+		}
+	}
+	cb->map = map;
+	cb->map_size = st.st_size;
+	return 0;
+
+miss:
+	munmap(map, st.st_size);
+	return -1;
+}
+
+static int write_all(int fd, const void *buf, size_t size)
+{
+	const uint8_t *p = buf;
+
+	while (size > 0) {
+		ssize_t n = write(fd, p, size);
+
+		if (n < 0)
+			return -1;
+		p += n;
+		size -= n;
+	}
+	return 0;
+}
+
+/*
+ * Write a cache file next to its final path, then rename it into place,
+ * so that concurrent readers never see a partial file.
+ */
+static void store(const char *dir, const char *path,
+		  const struct cache_key *key, const void *index,
+		  size_t index_size, const void *names, size_t names_size)
+{
+	struct cache_header header;
+	static const uint8_t pad[8];
+	char tmp[4096];
+	int fd, ret;
+
+	mkdir(dir, 0777);
+	snprintf(tmp, sizeof(tmp), "%s/.tmp-XXXXXX", dir);
+	fd = mkstemp(tmp);
+	if (fd < 0)
+		return;
+	/* mkstemp creates the file private to its owner */
+	fchmod(fd, 0644);
+
+	memset(&header, 0, sizeof(header));
+	header.magic = CACHE_MAGIC;
+	header.version = CACHE_VERSION;
+	header.key = *key;
+	header.index_offset = ALIGN8(sizeof(header));
+	header.index_size = index_size;
+	header.names_offset = ALIGN8(header.index_offset + index_size);
+	header.names_size = names_size;
+	header.index_crc32 = crc32(0, index, index_size);
+
+	ret = write_all(fd, &header, sizeof(header)) ||
+		write_all(fd, pad, header.index_offset - sizeof(header)) ||
+		write_all(fd, index, index_size) ||
+		write_all(fd, pad, header.names_offset -
+			  header.index_offset - index_size) ||
+		write_all(fd, names, names_size);
+	if (close(fd) < 0 || ret || rename(tmp, path) < 0)
+		unlink(tmp);
+}
+
+int cache_open(const char *dir, const struct mapped_file *file,
+	       int want_names, struct cached_blob *cb, struct error *err)
+{
+	struct cache_key key;
+	char path[4096];
+	void *index, *names = NULL;
+	size_t index_size, names_size = 0;
+
+	if (make_key(file, &key, err))
+		return -1;
+	cache_path(dir, &key, path, sizeof(path));
+	if (!load(path, &key, file, want_names, cb))
+		return 0;
+
+	if (blob_index_build(file->data, file->data_size, &index, &index_size,
+			     err))
+		return -1;
+	if (blob_try_init_index(&cb->blob, file->data, file->data_size,
+				index, index_size, err)) {
+		free(index);
+		return -1;
+	}
+	cb->names = NULL;
+	if (want_names) {
+		cb->names = names_create(cb->blob, err);
+		if (!cb->names) {
+			blob_destroy(cb->blob);
+			free(index);
+			return -1;
+		}
+		names = names_save(cb->names, &names_size);
+	}
+	cb->map = NULL;
+	cb->map_size = 0;
+
+	store(dir, path, &key, index, index_size, names, names_size);
+	free(names);
+	free(index);
+	return 0;
+}
+
+void cache_close(const struct cached_blob *cb)
+{
+	if (cb->names)
+		names_destroy(cb->names);
+	blob_destroy(cb->blob);
+	if (cb->map)
+		munmap((void *)cb->map, cb->map_size);
+}
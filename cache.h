@@ -0,0 +1,41 @@
+#ifndef ARSC_CACHE_H
+#define ARSC_CACHE_H
+#include <stddef.h>
+
+struct blob;
+struct error;
+struct mapped_file;
+struct names;
+
+/*
+ * On-disk cache of parsed blobs. A cache directory holds one file per
+ * resources.arsc (plain, or inside an apk), keyed by the size and mtime of
+ * the file and a CRC-32 of the resources.arsc data: the one stored in the
+ * apk, or one of sampled pages of a plain file. Each cache file holds the
+ * offset index of the blob (see blob_index_build) and, if it was built by
+ * a caller that wanted names, its name table (see names_save). It is used
+ * in place through mmap.
+ */
+struct cached_blob {
+	struct blob *blob;
+	struct names *names; /* NULL unless asked for */
+
+	/* the mmap'ed cache file, or NULL if the entry was just built */
+	const void *map;
+	size_t map_size;
+};
+
+/*
+ * Set up cb->blob (from its index) for file, and cb->names if want_names
+ * is set. Use the entry in dir if there is a valid one; otherwise parse
+ * file and store a new entry. Building names loads every type of the lazy
+ * blob, so an entry only holds names if they were wanted when it was
+ * stored; an entry without them is a miss for a caller that wants them.
+ * Failing to store the entry is not an error. Nothing needs to be cleaned
+ * up after a failure.
+ */
+int cache_open(const char *dir, const struct mapped_file *file,
+	       int want_names, struct cached_blob *cb, struct error *err);
+void cache_close(const struct cached_blob *cb);
+
+#endif
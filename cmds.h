@@ -1,7 +1,9 @@
 #ifndef ARSC_CMDS_H
 #define ARSC_CMDS_H
 
+int cmd_diff(int argc, char **argv);
 int cmd_dump(int argc, char **argv);
+int cmd_gen(int argc, char **argv);
 #ifndef NDEBUG
 int cmd_test(int argc, char **argv);
 #endif
@@ -0,0 +1,436 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arsc.h"
+#include "blob.h"
+#include "common.h"
+#include "config.h"
+#include "error.h"
+#include "filemap.h"
+#include "options.h"
+#include "resource.h"
+#include "strpool.h"
+
+/*
+ * One (resource, config) pair of a blob. The records of each blob are
+ * sorted by resource id, then by config, so that two blobs can be compared
+ * in a single merge pass.
+ */
+struct record {
+	uint32_t id;
+	uint32_t package; /* index into blob->packages */
+	const struct arsc_type *type;
+	const struct arsc_entry *entry;
+};
+
+struct side {
+	const char *path;
+	struct mapped_file map;
+	struct blob *blob;
+	struct config_cache *cache;
+	struct record *records;
+	size_t count;
+};
+
+/*
+ * String pools are compared once, as a whole: if both sides have
+ * identical pools, strings are equal exactly when their indices are.
+ */
+struct diff {
+	struct side a;
+	struct side b;
+	int values_identical;
+	signed char *keys_identical; /* per package of a; -1 is unknown */
+	size_t added, removed, configs_added, configs_removed, changed;
+};
+
+static int pools_identical(const struct arsc_string_pool *a,
+			   const struct arsc_string_pool *b)
+{
+	size_t size = dtohl(a->header.size);
+
+	return size == dtohl(b->header.size) && !memcmp(a, b, size);
+}
+
+static int strings_equal(const struct arsc_string_pool *pa, uint32_t a,
+			 const struct arsc_string_pool *pb, uint32_t b)
+{
+	struct pool_string sa, sb;
+	int ha = strpool_get(pa, a, &sa), hb = strpool_get(pb, b, &sb);
+
+	if (ha || hb)
+		return ha && hb;
+	if (sa.utf8)
+		return strpool_equals(&sb, sa.data, sa.len);
+	if (sb.utf8)
+		return strpool_equals(&sa, sb.data, sb.len);
+	return sa.len == sb.len && !memcmp(sa.data, sb.data, 2 * sa.len);
+}
+
+static int compare_records(const void *pa, const void *pb)
+{
+	const struct record *a = pa, *b = pb;
+
+	if (a->id != b->id)
+		return a->id < b->id ? -1 : 1;
+	return config_compare(&a->type->data.config, &b->type->data.config);
+}
+
+/* Call fn for every entry in every type of every package */
+static void for_each_entry(const struct blob *blob,
+			   void (*fn)(struct record *r, void *data),
+			   void *data)
+{
+	struct record r;
+	uint32_t i;
+
+	for (i = 0; i < dtohl(blob->header->data.package_count); i++) {
+		const struct package *pkg = &blob->packages[i];
+		uint8_t pkg_id = dtohl(pkg->package->data.id);
+		size_t j, k;
+
+		r.package = i;
+		for (j = 0; j < pkg->spec_count; j++) {
+			const struct type_spec *spec = &pkg->specs[j];
+			uint32_t count = dtohl(spec->spec->data.entry_count);
+			uint8_t type_id = spec->spec->data.id;
+
+			for (k = 0; k < spec->type_count; k++) {
+				uint32_t e;
+
+				r.type = spec->types[k];
+				/* entry ids are 16 bits */
+				for (e = 0; e < count && e <= 0xffff; e++) {
+					r.entry = resource_type_entry(r.type,
+								      e);
+					r.id = RESOURCE_ID(pkg_id, type_id, e);
+					if (r.entry)
+						fn(&r, data);
+				}
+			}
+		}
+	}
+}
+
+static void count_record(struct record *r, void *data)
+{
+	(void)r;
+	((struct side *)data)->count++;
+}
+
+static void add_record(struct record *r, void *data)
+{
+	struct side *s = data;
+
+	s->records[s->count++] = *r;
+}
+
+/* Collect the records of a blob: count them, allocate once, and sort */
+static void collect(struct side *s)
+{
+	s->count = 0;
+	for_each_entry(s->blob, count_record, s);
+	s->records = xcalloc(s->count + 1, sizeof(struct record));
+	s->count = 0;
+	for_each_entry(s->blob, add_record, s);
+	qsort(s->records, s->count, sizeof(struct record), compare_records);
+}
+
+static const struct package *record_package(const struct side *s,
+					    const struct record *r)
+{
+	return &s->blob->packages[r->package];
+}
+
+/*
+ * Record entries come from resource_type_entry, which has checked that the
+ * value, or the maps of a complex entry, fit in the type chunk.
+ */
+static const struct arsc_value *simple_value(const struct record *r)
+{
+	return (const struct arsc_value *)
+		((const uint8_t *)r->entry + dtohs(r->entry->size));
+}
+
+static const struct arsc_map_entry *map_entry(const struct record *r,
+					      const struct arsc_map **maps)
+{
+	const struct arsc_map_entry *m =
+		(const struct arsc_map_entry *)r->entry;
+
+	*maps = (const struct arsc_map *)
+		((const uint8_t *)m + dtohs(r->entry->size));
+	return m;
+}
+
+static int values_equal(const struct diff *d, const struct arsc_value *a,
+			const struct arsc_value *b)
+{
+	if (a->data_type != b->data_type)
+		return 0;
+	if (a->data_type != ARSC_VALUE_TYPE_STRING || d->values_identical)
+		return a->data == b->data;
+	return strings_equal(d->a.blob->sp_values, dtohl(a->data),
+			     d->b.blob->sp_values, dtohl(b->data));
+}
+
+static int keys_equal(struct diff *d, const struct record *ra,
+		      const struct record *rb)
+{
+	const struct package *pa = record_package(&d->a, ra);
+	const struct package *pb = record_package(&d->b, rb);
+	signed char *identical = &d->keys_identical[ra->package];
+
+	if (*identical < 0)
+		*identical = pools_identical(pa->sp_resource_names,
+					     pb->sp_resource_names);
+	if (*identical)
+		return ra->entry->key == rb->entry->key;
+	return strings_equal(pa->sp_resource_names, dtohl(ra->entry->key),
+			     pb->sp_resource_names, dtohl(rb->entry->key));
+}
+
+static int entries_equal(struct diff *d, const struct record *ra,
+			 const struct record *rb)
+{
+	uint16_t flags_a = dtohs(ra->entry->flags);
+	uint16_t flags_b = dtohs(rb->entry->flags);
+	const struct arsc_map_entry *ma, *mb;
+	const struct arsc_map *maps_a, *maps_b;
+	uint32_t i;
+
+	if ((flags_a ^ flags_b) & ARSC_ENTRY_FLAG_COMPLEX ||
+	    !keys_equal(d, ra, rb))
+		return 0;
+	if (!(flags_a & ARSC_ENTRY_FLAG_COMPLEX))
+		return values_equal(d, simple_value(ra), simple_value(rb));
+
+	ma = map_entry(ra, &maps_a);
+	mb = map_entry(rb, &maps_b);
+	if (ma->parent != mb->parent || ma->count != mb->count)
+		return 0;
+	for (i = 0; i < dtohl(ma->count); i++) {
+		if (maps_a[i].name != maps_b[i].name ||
+		    !values_equal(d, &maps_a[i].value, &maps_b[i].value))
+			return 0;
+	}
+	return 1;
+}
+
+static void print_string(FILE *out, const struct pool_string *str)
+{
+	char buf[256];
+	size_t len = strpool_to_utf8(str, buf, sizeof(buf));
+
+	fprintf(out, "%s%s", buf, len < sizeof(buf) ? "" : "...");
+}
+
+static void print_name(FILE *out, const struct side *s,
+		       const struct record *r)
+{
+	const struct package *pkg = record_package(s, r);
+	struct pool_string str;
+
+	fprintf(out, "id=0x%08x name=", r->id);
+	if (resource_type_name(pkg, RESOURCE_TYPE_ID(r->id), &str))
+		fprintf(out, "?");
+	else
+		print_string(out, &str);
+	fprintf(out, "/");
+	if (strpool_get(pkg->sp_resource_names, dtohl(r->entry->key), &str))
+		fprintf(out, "?");
+	else
+		print_string(out, &str);
+}
+
+static void print_config(FILE *out, struct side *s, const struct record *r)
+{
+	size_t len;
+
+	fprintf(out, " config=%s",
+		config_cache_string(s->cache, &r->type->data.config, &len));
+}
+
+static void print_value(FILE *out, const struct side *s,
+			const struct record *r)
+{
+	const struct arsc_value *value;
+	const struct arsc_map *maps;
+	struct pool_string str;
+
+	if (dtohs(r->entry->flags) & ARSC_ENTRY_FLAG_COMPLEX) {
+		fprintf(out, "map(count=%u)",
+			dtohl(map_entry(r, &maps)->count));
+		return;
+	}
+	value = simple_value(r);
+	if (value->data_type == ARSC_VALUE_TYPE_STRING &&
+	    !strpool_get(s->blob->sp_values, dtohl(value->data), &str)) {
+		fprintf(out, "\"");
+		print_string(out, &str);
+		fprintf(out, "\"");
+	} else
+		fprintf(out, "0x%02x:0x%08x", value->data_type,
+			dtohl(value->data));
+}
+
+/* Compare the configs of one resource that exists on both sides */
+static void diff_configs(struct diff *d, FILE *out,
+			 const struct record *a, size_t na,
+			 const struct record *b, size_t nb)
+{
+	size_t i = 0, j = 0;
+
+	while (i < na || j < nb) {
+		int c = i == na ? 1 : j == nb ? -1 :
+			config_compare(&a[i].type->data.config,
+				       &b[j].type->data.config);
+
+		if (c < 0) {
+			fprintf(out, "config removed: ");
+			print_name(out, &d->a, &a[i]);
+			print_config(out, &d->a, &a[i]);
+			fprintf(out, "\n");
+			d->configs_removed++;
+			i++;
+		} else if (c > 0) {
+			fprintf(out, "config added: ");
+			print_name(out, &d->b, &b[j]);
+			print_config(out, &d->b, &b[j]);
+			fprintf(out, "\n");
+			d->configs_added++;
+			j++;
+		} else {
+			if (!entries_equal(d, &a[i], &b[j])) {
+				fprintf(out, "changed: ");
+				print_name(out, &d->b, &b[j]);
+				print_config(out, &d->b, &b[j]);
+				fprintf(out, " old=");
+				print_value(out, &d->a, &a[i]);
+				fprintf(out, " new=");
+				print_value(out, &d->b, &b[j]);
+				fprintf(out, "\n");
+				d->changed++;
+			}
+			i++;
+			j++;
+		}
+	}
+}
+
+/* Return the number of records from r on that share r's resource id */
+static size_t group_size(const struct record *r, size_t left)
+{
+	size_t n = 1;
+
+	while (n < left && r[n].id == r->id)
+		n++;
+	return n;
+}
+
+static void diff_records(struct diff *d, FILE *out)
+{
+	const struct record *a = d->a.records, *b = d->b.records;
+	size_t i = 0, j = 0;
+
+	while (i < d->a.count || j < d->b.count) {
+		size_t na = i < d->a.count ?
+			group_size(&a[i], d->a.count - i) : 0;
+		size_t nb = j < d->b.count ?
+			group_size(&b[j], d->b.count - j) : 0;
+
+		if (nb == 0 || (na > 0 && a[i].id < b[j].id)) {
+			fprintf(out, "removed: ");
+			print_name(out, &d->a, &a[i]);
+			fprintf(out, "\n");
+			d->removed++;
+			i += na;
+		} else if (na == 0 || b[j].id < a[i].id) {
+			fprintf(out, "added: ");
+			print_name(out, &d->b, &b[j]);
+			fprintf(out, "\n");
+			d->added++;
+			j += nb;
+		} else {
+			diff_configs(d, out, &a[i], na, &b[j], nb);
+			i += na;
+			j += nb;
+		}
+	}
+}
+
+static int open_side(struct side *s, const char *path)
+{
+	struct error err;
+
+	s->path = path;
+	if (map_file_try(path, &s->map, &err))
+		goto fail;
+	if (blob_try_init(&s->blob, s->map.data, s->map.data_size, &err)) {
+		unmap_file(&s->map);
+		goto fail;
+	}
+	s->cache = config_cache_create();
+	collect(s);
+	return 0;
+
+fail:
+	fprintf(stderr, "%s: %s: offset=%zd: %s\n", path,
+		error_status_string(err.status), err.offset, err.message);
+	return -1;
+}
+
+static void close_side(struct side *s)
+{
+	free(s->records);
+	config_cache_destroy(s->cache);
+	blob_destroy(s->blob);
+	unmap_file(&s->map);
+}
+
+static struct option_spec diff_option_specs[] = {
+	OPT_END,
+};
+
+/*
+ * Exit status as for diff(1): 0 if the blobs define the same resources
+ * with the same values, 1 if they differ, 2 on errors.
+ */
+int cmd_diff(int argc, char **argv)
+{
+	struct diff d;
+	size_t total;
+
+	argc = parse_options(diff_option_specs, argc, argv);
+
+	die_if(argc != 2, "usage: arsc diff <old-file> <new-file>");
+
+	memset(&d, 0, sizeof(d));
+	if (open_side(&d.a, argv[0]))
+		return 2;
+	if (open_side(&d.b, argv[1])) {
+		close_side(&d.a);
+		return 2;
+	}
+
+	d.values_identical = pools_identical(d.a.blob->sp_values,
+					     d.b.blob->sp_values);
+	d.keys_identical = xmalloc(
+		dtohl(d.a.blob->header->data.package_count) + 1);
+	memset(d.keys_identical, -1,
+	       dtohl(d.a.blob->header->data.package_count) + 1);
+
+	diff_records(&d, stdout);
+	total = d.added + d.removed + d.configs_added + d.configs_removed +
+		d.changed;
+	printf("summary: added=%zd removed=%zd configs_added=%zd "
+	       "configs_removed=%zd changed=%zd\n",
+	       d.added, d.removed, d.configs_added, d.configs_removed,
+	       d.changed);
+
+	free(d.keys_identical);
+	close_side(&d.b);
+	close_side(&d.a);
+	return total ? 1 : 0;
+}
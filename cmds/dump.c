@@ -1,72 +1,671 @@
+#include <fcntl.h>
+#include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "arsc.h"
 #include "blob.h"
+#include "cache.h"
 #include "common.h"
 #include "config.h"
+#include "error.h"
 #include "filemap.h"
+#include "json.h"
 #include "options.h"
+#include "resource.h"
+#include "strpool.h"
+#include "zip.h"
 
-static void dump_type(const struct arsc_type *type)
+enum format {
+	FORMAT_TEXT,
+	FORMAT_JSON,
+	FORMAT_NDJSON,
+};
+
+static enum format format = FORMAT_TEXT;
+
+/*
+ * Only type specs named filter.type, and only types whose config has all
+ * the qualifiers of filter.config, are dumped. Both tests run on the raw
+ * chunk data, so skipped types are never formatted. With a cache, the blob
+ * is set up from its index, and the types of skipped specs are never
+ * loaded (see load_types).
+ */
+static struct {
+	const char *type;
+	size_t type_len;
+	int has_config;
+	struct config_filter config;
+} filter;
+
+static int filter_spec(const struct package *pkg,
+		       const struct type_spec *spec)
+{
+	struct pool_string name;
+
+	if (filter.type &&
+	    (resource_type_name(pkg, spec->spec->data.id, &name) ||
+	     !strpool_equals(&name, filter.type, filter.type_len)))
+		return 0;
+	return 1;
+}
+
+/*
+ * Load the types of the specs that pass the filter, before anything is
+ * printed, so that a malformed type run fails the file as a whole.
+ */
+static int load_types(const struct blob *blob, struct error *err)
+{
+	uint32_t i;
+	size_t j;
+
+	for (i = 0; i < dtohl(blob->header->data.package_count); i++) {
+		const struct package *pkg = &blob->packages[i];
+
+		for (j = 0; j < pkg->spec_count; j++) {
+			if (filter_spec(pkg, &pkg->specs[j]) &&
+			    blob_load_types(blob, &pkg->specs[j], err))
+				return -1;
+		}
+	}
+	return 0;
+}
+
+static int filter_type(const struct arsc_type *type)
 {
-	char c[CONFIG_LEN];
+	return !filter.has_config ||
+		config_filter_match(&filter.config, &type->data.config);
+}
 
-	config_to_string(&type->data.config, c);
-	printf("type: id=0x%02x entry_count=%d entries_start=0x%02x config=%s\n",
-	       dtohs(type->data.id), dtohl(type->data.entry_count),
-	       dtohl(type->data.entries_start), c);
+static void dump_type(FILE *out, struct config_cache *cache,
+		      const struct arsc_type *type)
+{
+	size_t len;
+	const char *c = config_cache_string(cache, &type->data.config, &len);
+
+	fprintf(out,
+		"type: id=0x%02x entry_count=%d entries_start=0x%02x config=%s\n",
+		dtohs(type->data.id), dtohl(type->data.entry_count),
+		dtohl(type->data.entries_start), c);
 }
 
-static void dump(const struct blob *blob)
+static void dump(FILE *out, struct config_cache *cache, const char *path,
+		 const struct blob *blob)
 {
 	uint32_t i;
 
-	printf("header: package_count=%d\n",
-	       dtohl(blob->header->data.package_count));
-	printf("string pool (resource values): string_count=%d\n",
-	       dtohl(blob->sp_values->data.string_count));
+	if (path)
+		fprintf(out, "file: %s\n", path);
+	fprintf(out, "header: package_count=%d\n",
+		dtohl(blob->header->data.package_count));
+	fprintf(out, "string pool (resource values): string_count=%d\n",
+		dtohl(blob->sp_values->data.string_count));
 	for (i = 0; i < dtohl(blob->header->data.package_count); i++) {
 		const struct package *pkg = &blob->packages[i];
 		size_t j;
 
-		printf("package: id=0x%02x spec_count=%zd\n",
-		       dtohl(pkg->package->data.id), pkg->spec_count);
-		printf("string pool (type names): string_count=%d\n",
-		       dtohl(pkg->sp_type_names->data.string_count));
-		printf("string pool (resource names): string_count=%d\n",
-		       dtohl(pkg->sp_resource_names->data.string_count));
+		fprintf(out, "package: id=0x%02x spec_count=%zd\n",
+			dtohl(pkg->package->data.id), pkg->spec_count);
+		fprintf(out, "string pool (type names): string_count=%d\n",
+			dtohl(pkg->sp_type_names->data.string_count));
+		fprintf(out, "string pool (resource names): string_count=%d\n",
+			dtohl(pkg->sp_resource_names->data.string_count));
 		for (j = 0; j < pkg->spec_count; j++) {
 			const struct type_spec *spec = &pkg->specs[j];
 			size_t k;
 
-			printf("type spec: id=0x%02x type_count=%zd\n",
-			       dtohs(spec->spec->data.id), spec->type_count);
+			if (!filter_spec(pkg, spec))
+				continue;
+			fprintf(out, "type spec: id=0x%02x type_count=%zd\n",
+				dtohs(spec->spec->data.id), spec->type_count);
 			for (k = 0; k < spec->type_count; k++) {
 				const struct arsc_type *type = spec->types[k];
-				dump_type(type);
+
+				if (filter_type(type))
+					dump_type(out, cache, type);
+			}
+		}
+	}
+}
+
+static void json_type_name(struct json_writer *w, const struct package *pkg,
+			   uint8_t type_id)
+{
+	struct pool_string name;
+	char buf[256];
+	size_t len;
+
+	if (resource_type_name(pkg, type_id, &name))
+		return;
+	len = strpool_to_utf8(&name, buf, sizeof(buf));
+	json_string(w, "name", buf, len < sizeof(buf) ? len : sizeof(buf) - 1);
+}
+
+static void json_type(struct json_writer *w, struct config_cache *cache,
+		      const struct arsc_type *type)
+{
+	size_t len;
+	const char *c = config_cache_string(cache, &type->data.config, &len);
+
+	json_uint(w, "id", type->data.id);
+	json_uint(w, "entry_count", dtohl(type->data.entry_count));
+	json_uint(w, "entries_start", dtohl(type->data.entries_start));
+	json_string(w, "config", c, len);
+}
+
+/*
+ * JSON: one document per file, nesting packages, type specs and types.
+ */
+static void dump_json(struct json_writer *w, struct config_cache *cache,
+		      const char *path, const struct blob *blob)
+{
+	uint32_t i;
+
+	json_begin_object(w, NULL);
+	if (path)
+		json_string(w, "file", path, strlen(path));
+	json_uint(w, "package_count",
+		  dtohl(blob->header->data.package_count));
+	json_uint(w, "value_string_count",
+		  dtohl(blob->sp_values->data.string_count));
+	json_begin_array(w, "packages");
+	for (i = 0; i < dtohl(blob->header->data.package_count); i++) {
+		const struct package *pkg = &blob->packages[i];
+		size_t j;
+
+		json_begin_object(w, NULL);
+		json_uint(w, "id", dtohl(pkg->package->data.id));
+		json_uint(w, "type_name_string_count",
+			  dtohl(pkg->sp_type_names->data.string_count));
+		json_uint(w, "resource_name_string_count",
+			  dtohl(pkg->sp_resource_names->data.string_count));
+		json_begin_array(w, "type_specs");
+		for (j = 0; j < pkg->spec_count; j++) {
+			const struct type_spec *spec = &pkg->specs[j];
+			size_t k;
+
+			if (!filter_spec(pkg, spec))
+				continue;
+			json_begin_object(w, NULL);
+			json_uint(w, "id", spec->spec->data.id);
+			json_type_name(w, pkg, spec->spec->data.id);
+			json_uint(w, "entry_count",
+				  dtohl(spec->spec->data.entry_count));
+			json_begin_array(w, "types");
+			for (k = 0; k < spec->type_count; k++) {
+				if (!filter_type(spec->types[k]))
+					continue;
+				json_begin_object(w, NULL);
+				json_type(w, cache, spec->types[k]);
+				json_end_object(w);
+			}
+			json_end_array(w);
+			json_end_object(w);
+		}
+		json_end_array(w);
+		json_end_object(w);
+	}
+	json_end_array(w);
+	json_end_object(w);
+	json_newline(w);
+}
+
+/*
+ * NDJSON: one flat record per line, for the blob, packages, type specs and
+ * types. Every record carries the ids of its parents, so lines can be
+ * processed independently.
+ */
+static void dump_ndjson(struct json_writer *w, struct config_cache *cache,
+			const char *path, const struct blob *blob)
+{
+	uint32_t i;
+
+	json_begin_object(w, NULL);
+	json_string(w, "kind", "blob", 4);
+	if (path)
+		json_string(w, "file", path, strlen(path));
+	json_uint(w, "package_count",
+		  dtohl(blob->header->data.package_count));
+	json_uint(w, "value_string_count",
+		  dtohl(blob->sp_values->data.string_count));
+	json_end_object(w);
+	json_newline(w);
+	for (i = 0; i < dtohl(blob->header->data.package_count); i++) {
+		const struct package *pkg = &blob->packages[i];
+		uint32_t pkg_id = dtohl(pkg->package->data.id);
+		size_t j;
+
+		json_begin_object(w, NULL);
+		json_string(w, "kind", "package", 7);
+		if (path)
+			json_string(w, "file", path, strlen(path));
+		json_uint(w, "id", pkg_id);
+		json_uint(w, "spec_count", pkg->spec_count);
+		json_end_object(w);
+		json_newline(w);
+		for (j = 0; j < pkg->spec_count; j++) {
+			const struct type_spec *spec = &pkg->specs[j];
+			size_t k;
+
+			if (!filter_spec(pkg, spec))
+				continue;
+			json_begin_object(w, NULL);
+			json_string(w, "kind", "type_spec", 9);
+			if (path)
+				json_string(w, "file", path, strlen(path));
+			json_uint(w, "package", pkg_id);
+			json_uint(w, "id", spec->spec->data.id);
+			json_type_name(w, pkg, spec->spec->data.id);
+			json_uint(w, "entry_count",
+				  dtohl(spec->spec->data.entry_count));
+			json_uint(w, "type_count", spec->type_count);
+			json_end_object(w);
+			json_newline(w);
+			for (k = 0; k < spec->type_count; k++) {
+				if (!filter_type(spec->types[k]))
+					continue;
+				json_begin_object(w, NULL);
+				json_string(w, "kind", "type", 4);
+				if (path)
+					json_string(w, "file", path,
+						    strlen(path));
+				json_uint(w, "package", pkg_id);
+				json_type(w, cache, spec->types[k]);
+				json_end_object(w);
+				json_newline(w);
+			}
+		}
+	}
+}
+
+static void dump_blob(FILE *out, const char *path, const struct blob *blob)
+{
+	struct config_cache *cache = config_cache_create();
+	struct json_writer *w;
+
+	if (format == FORMAT_TEXT) {
+		dump(out, cache, path, blob);
+	} else {
+		w = xmalloc(sizeof(*w));
+		json_init(w, out);
+		if (format == FORMAT_JSON)
+			dump_json(w, cache, path, blob);
+		else
+			dump_ndjson(w, cache, path, blob);
+		json_flush(w);
+		free(w);
+	}
+	config_cache_destroy(cache);
+}
+
+/*
+ * --stream: read the file with blob_stream instead of mapping it. The
+ * string pools are skipped, so only the type lines of the text format are
+ * printed. In an apk, the resources.arsc entry is streamed in place, so it
+ * must be stored rather than compressed, as the platform requires anyway.
+ */
+struct stream_dump {
+	FILE *out;
+	struct config_cache *cache;
+};
+
+static int stream_type(const struct blob_stream_chunk *chunk, void *data)
+{
+	struct stream_dump *sd = data;
+
+	if (filter_type(chunk->type))
+		dump_type(sd->out, sd->cache, chunk->type);
+	return 0;
+}
+
+static int stream_file(FILE *out, const char *path, int show_path,
+		       struct error *err)
+{
+	struct stream_dump sd = { out, NULL };
+	uint64_t offset = 0, length;
+	uint32_t magic = 0;
+	struct stat st;
+	int fd, ret = -1;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		error_set(err, ERROR_IO, 0, "open %s", path);
+		return -1;
+	}
+	if (fstat(fd, &st) < 0) {
+		error_set(err, ERROR_IO, 0, "stat %s", path);
+		goto out;
+	}
+	length = st.st_size;
+	if (pread(fd, &magic, sizeof(magic), 0) == sizeof(magic) &&
+	    zip_is_zip(&magic, sizeof(magic)) &&
+	    zip_locate_stored(fd, st.st_size, "resources.arsc", &offset,
+			      &length, err))
+		goto out;
+	sd.cache = config_cache_create();
+	if (show_path)
+		fprintf(out, "file: %s\n", path);
+	ret = blob_stream(fd, offset, length, stream_type, &sd, err);
+	config_cache_destroy(sd.cache);
+out:
+	close(fd);
+	return ret;
+}
+
+/*
+ * Dump the file at path to out. If show_path is set, the output is tagged
+ * with the path.
+ */
+static const char *cache_dir;
+static struct map_options map_options = MAP_OPTIONS_INIT;
+static int stream;
+
+static int dump_file(FILE *out, const char *path, int show_path,
+		     struct error *err)
+{
+	struct mapped_file map;
+	struct cached_blob cb;
+	struct blob *blob;
+
+	if (stream)
+		return stream_file(out, path, show_path, err);
+	if (map_file_try_opts(path, &map_options, &map, err))
+		return -1;
+	if (cache_dir) {
+		/* dump never looks up names, so leave the types lazy */
+		if (cache_open(cache_dir, &map, 0, &cb, err)) {
+			unmap_file(&map);
+			return -1;
+		}
+		if (load_types(cb.blob, err)) {
+			cache_close(&cb);
+			unmap_file(&map);
+			return -1;
+		}
+		dump_blob(out, show_path ? path : NULL, cb.blob);
+		cache_close(&cb);
+		unmap_file(&map);
+		return 0;
+	}
+	if (blob_try_init(&blob, map.data, map.data_size, err)) {
+		unmap_file(&map);
+		return -1;
+	}
+	dump_blob(out, show_path ? path : NULL, blob);
+	blob_destroy(blob);
+	unmap_file(&map);
+	return 0;
+}
+
+static void print_error(const char *path, const struct error *err)
+{
+	fprintf(stderr, "%s: %s: offset=%zd: %s", path,
+		error_status_string(err->status), err->offset, err->message);
+	if (err->errnum)
+		fprintf(stderr, ": %s", strerror(err->errnum));
+	fprintf(stderr, "\n");
+}
+
+/*
+ * Batch mode: dump many files on a pool of worker threads.
+ *
+ * Jobs are numbered in input order. Each worker dumps a job into its own
+ * memory buffer; the main thread writes the buffers to stdout strictly in
+ * job order and frees them. At most window jobs are in flight at any time,
+ * so memory use is bounded by the window size, not by the number of
+ * inputs. Paths read from stdin are likewise consumed lazily. A file that
+ * fails to parse is reported on stderr, in order, and skipped.
+ */
+struct job {
+	char *path;
+	char *out;
+	size_t out_size;
+	struct error err;
+	int failed;
+	int done;
+};
+
+struct batch {
+	pthread_mutex_t lock;
+	pthread_cond_t work; /* a job was queued, or input ended */
+	pthread_cond_t done; /* a job finished */
+	struct job *jobs;
+	size_t window;
+	size_t queued;
+	size_t taken;
+	int eof;
+};
+
+static void *batch_worker(void *arg)
+{
+	struct batch *b = arg;
+
+	for (;;) {
+		struct job *job;
+		FILE *out;
+
+		pthread_mutex_lock(&b->lock);
+		while (b->taken == b->queued && !b->eof)
+			pthread_cond_wait(&b->work, &b->lock);
+		if (b->taken == b->queued) {
+			pthread_mutex_unlock(&b->lock);
+			return NULL;
+		}
+		job = &b->jobs[b->taken++ % b->window];
+		pthread_mutex_unlock(&b->lock);
+
+		out = open_memstream(&job->out, &job->out_size);
+		die_if(!out, "open_memstream");
+		job->failed = dump_file(out, job->path, 1, &job->err) != 0;
+		fclose(out);
+
+		pthread_mutex_lock(&b->lock);
+		job->done = 1;
+		pthread_cond_broadcast(&b->done);
+		pthread_mutex_unlock(&b->lock);
+	}
+}
+
+/* Return the next input path (malloc'ed), or NULL at end of input */
+static char *next_path(int *argc, char ***argv, int from_stdin)
+{
+	char *line = NULL;
+	size_t size = 0;
+	ssize_t len;
+
+	if (!from_stdin) {
+		if (*argc == 0)
+			return NULL;
+		(*argc)--;
+		return strdup(*(*argv)++);
+	}
+
+	while ((len = getline(&line, &size, stdin)) >= 0) {
+		if (len > 0 && line[len - 1] == '\n')
+			line[--len] = '\0';
+		if (len > 0)
+			return line;
+	}
+	free(line);
+	return NULL;
+}
+
+static int dump_batch(int argc, char **argv, int from_stdin, int jobs)
+{
+	struct batch b;
+	pthread_t *threads;
+	size_t written = 0;
+	int i, ret = 0;
+
+	if (jobs <= 0)
+		jobs = sysconf(_SC_NPROCESSORS_ONLN);
+	if (jobs <= 0)
+		jobs = 1;
+
+	pthread_mutex_init(&b.lock, NULL);
+	pthread_cond_init(&b.work, NULL);
+	pthread_cond_init(&b.done, NULL);
+	b.window = 2 * jobs;
+	b.jobs = xcalloc(b.window, sizeof(struct job));
+	b.queued = 0;
+	b.taken = 0;
+	b.eof = 0;
+
+	threads = xcalloc(jobs, sizeof(pthread_t));
+	for (i = 0; i < jobs; i++)
+		die_if(pthread_create(&threads[i], NULL, batch_worker, &b),
+		       "pthread_create");
+
+	for (;;) {
+		struct job *job;
+
+		/* keep the window full */
+		while (!b.eof && b.queued - written < b.window) {
+			char *path = next_path(&argc, &argv, from_stdin);
+
+			pthread_mutex_lock(&b.lock);
+			if (path) {
+				job = &b.jobs[b.queued++ % b.window];
+				job->path = path;
+				job->out = NULL;
+				job->done = 0;
+			} else {
+				b.eof = 1;
 			}
+			pthread_cond_broadcast(&b.work);
+			pthread_mutex_unlock(&b.lock);
 		}
+		if (b.eof && written == b.queued)
+			break;
+
+		/* write the oldest job as soon as it is done */
+		job = &b.jobs[written % b.window];
+		pthread_mutex_lock(&b.lock);
+		while (!job->done)
+			pthread_cond_wait(&b.done, &b.lock);
+		pthread_mutex_unlock(&b.lock);
+
+		if (job->failed) {
+			fflush(stdout);
+			print_error(job->path, &job->err);
+			ret = 1;
+		} else {
+			fwrite(job->out, 1, job->out_size, stdout);
+		}
+		free(job->out);
+		free(job->path);
+		written++;
 	}
+
+	for (i = 0; i < jobs; i++)
+		pthread_join(threads[i], NULL);
+	free(threads);
+	free(b.jobs);
+	pthread_cond_destroy(&b.done);
+	pthread_cond_destroy(&b.work);
+	pthread_mutex_destroy(&b.lock);
+	return ret;
 }
 
+static struct {
+	int jobs;
+	int from_stdin;
+	const char *format;
+	const char *config;
+	const char *type;
+	const char *cache_dir;
+	const char *madvise;
+	int populate;
+	int map_whole_file;
+	int stream;
+} dump_opts = { 0, 0, "text", NULL, NULL, NULL, NULL, 0, 0, 0 };
+
 static struct option_spec dump_option_specs[] = {
+	OPT_INTEGER('j', "jobs", &dump_opts.jobs),
+	OPT_BOOL(0, "stdin", &dump_opts.from_stdin),
+	OPT_STRING(0, "format", &dump_opts.format),
+	OPT_STRING(0, "config", &dump_opts.config),
+	OPT_STRING(0, "type", &dump_opts.type),
+	OPT_STRING(0, "cache-dir", &dump_opts.cache_dir),
+	OPT_STRING(0, "madvise", &dump_opts.madvise),
+	OPT_BOOL(0, "populate", &dump_opts.populate),
+	OPT_BOOL(0, "map-whole-file", &dump_opts.map_whole_file),
+	OPT_BOOL(0, "stream", &dump_opts.stream),
 	OPT_END,
 };
 
 int cmd_dump(int argc, char **argv)
 {
-	struct mapped_file map;
-	struct blob *blob;
+	struct error err;
 
 	argc = parse_options(dump_option_specs, argc, argv);
 
-	die_if(argc == 0, "usage: arsc dump <resource-file-or-apk>");
+	/* paths come either from the command line or from stdin */
+	die_if(dump_opts.from_stdin ? argc != 0 : argc == 0,
+	       "usage: arsc dump [-j <n> | --jobs=<n>] "
+	       "[--format=text|json|ndjson] [--config=<qualifiers>] "
+	       "[--type=<name>] [--cache-dir=<dir>] "
+	       "[--madvise=normal|sequential|random] [--populate] "
+	       "[--map-whole-file] [--stream] "
+	       "(<resource-file-or-apk>... | --stdin)");
 
-	map_file(argv[0], &map);
-	blob_init(&blob, map.data, map.data_size);
-	dump(blob);
-	blob_destroy(blob);
-	unmap_file(&map);
+	if (!strcmp(dump_opts.format, "text"))
+		format = FORMAT_TEXT;
+	else if (!strcmp(dump_opts.format, "json"))
+		format = FORMAT_JSON;
+	else if (!strcmp(dump_opts.format, "ndjson"))
+		format = FORMAT_NDJSON;
+	else
+		die("unknown format '%s'", dump_opts.format);
+
+	if (dump_opts.config) {
+		struct arsc_config config;
+
+		die_if(config_from_string(dump_opts.config, &config),
+		       "bad config '%s'", dump_opts.config);
+		config_filter_init(&filter.config, &config);
+		filter.has_config = 1;
+	}
+	cache_dir = dump_opts.cache_dir;
+	if (dump_opts.type) {
+		filter.type = dump_opts.type;
+		filter.type_len = strlen(dump_opts.type);
+	}
 
+	/*
+	 * A parse reads the blob front to back; a blob set up from a cached
+	 * index only touches the chunks that are dumped.
+	 */
+	if (!dump_opts.madvise)
+		map_options.access = cache_dir ? MAP_ACCESS_RANDOM :
+			MAP_ACCESS_SEQUENTIAL;
+	else if (!strcmp(dump_opts.madvise, "normal"))
+		map_options.access = MAP_ACCESS_NORMAL;
+	else if (!strcmp(dump_opts.madvise, "sequential"))
+		map_options.access = MAP_ACCESS_SEQUENTIAL;
+	else if (!strcmp(dump_opts.madvise, "random"))
+		map_options.access = MAP_ACCESS_RANDOM;
+	else
+		die("unknown madvise hint '%s'", dump_opts.madvise);
+	map_options.populate = dump_opts.populate;
+	map_options.whole_file = dump_opts.map_whole_file;
+
+	stream = dump_opts.stream;
+	die_if(stream && (format != FORMAT_TEXT || dump_opts.type ||
+			  cache_dir),
+	       "--stream only supports the text format, without --type or "
+	       "--cache-dir");
+
+	if (argc > 1 || dump_opts.from_stdin)
+		return dump_batch(argc, argv, dump_opts.from_stdin,
+				  dump_opts.jobs);
+
+	if (dump_file(stdout, argv[0], 0, &err)) {
+		print_error(argv[0], &err);
+		return 1;
+	}
 	return 0;
 }
@@ -0,0 +1,514 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#include "arsc.h"
+#include "common.h"
+#include "config.h"
+#include "options.h"
+
+/*
+ * arsc gen: write a synthetic resources.arsc, or a stored apk holding one,
+ * for scale testing. The output is a pure function of the options, so the
+ * same command line always produces the same file.
+ *
+ * Every package has the same layout: --types type specs of --entries
+ * entries each, and --configs types per type spec. The first config is
+ * the default config and defines every entry; the others define --fill
+ * percent of the entries, in a dense (offset array) or a sparse (index,
+ * offset pairs) entry table. Values are references into a value string
+ * pool of --strings strings of --string-length characters, or plain
+ * integers if --strings is 0. --config-size writes the configs of older
+ * versions of the format, which stop short of the later qualifiers.
+ *
+ * The blob is built in memory: chunk sizes are patched in once a chunk
+ * has been written. Integers are stored in device order; dtoh* are their
+ * own inverse.
+ */
+static struct {
+	int packages;
+	int types;
+	int configs;
+	int entries;
+	int strings;
+	int string_length;
+	int fill;
+	int utf16;
+	int sparse;
+	int apk;
+	int config_size;
+} gen_opts = { 1, 10, 4, 100, 1000, 16, 50, 0, 0, 0,
+	       sizeof(struct arsc_config) };
+
+static struct option_spec gen_option_specs[] = {
+	OPT_INTEGER(0, "packages", &gen_opts.packages),
+	OPT_INTEGER(0, "types", &gen_opts.types),
+	OPT_INTEGER(0, "configs", &gen_opts.configs),
+	OPT_INTEGER(0, "entries", &gen_opts.entries),
+	OPT_INTEGER(0, "strings", &gen_opts.strings),
+	OPT_INTEGER(0, "string-length", &gen_opts.string_length),
+	OPT_INTEGER(0, "fill", &gen_opts.fill),
+	OPT_BOOL(0, "utf16", &gen_opts.utf16),
+	OPT_BOOL(0, "sparse", &gen_opts.sparse),
+	OPT_BOOL(0, "apk", &gen_opts.apk),
+	OPT_INTEGER(0, "config-size", &gen_opts.config_size),
+	OPT_END,
+};
+
+struct buffer {
+	uint8_t *data;
+	size_t size;
+	size_t capacity;
+};
+
+/* append size zeroed bytes to buf, and return their offset */
+static size_t buffer_append(struct buffer *buf, size_t size)
+{
+	size_t offset = buf->size;
+
+	if (buf->capacity - buf->size < size) {
+		if (!buf->capacity)
+			buf->capacity = 4096;
+		while (buf->capacity - buf->size < size)
+			buf->capacity *= 2;
+		buf->data = xrealloc(buf->data, buf->capacity);
+	}
+	memset(buf->data + offset, 0, size);
+	buf->size += size;
+	return offset;
+}
+
+static void put(struct buffer *buf, const void *p, size_t size)
+{
+	size_t offset = buffer_append(buf, size);
+
+	memcpy(buf->data + offset, p, size);
+}
+
+static void put16(struct buffer *buf, uint16_t v)
+{
+	v = dtohs(v);
+	put(buf, &v, sizeof(v));
+}
+
+static void put32(struct buffer *buf, uint32_t v)
+{
+	v = dtohl(v);
+	put(buf, &v, sizeof(v));
+}
+
+static void patch32(struct buffer *buf, size_t offset, uint32_t v)
+{
+	v = dtohl(v);
+	memcpy(buf->data + offset, &v, sizeof(v));
+}
+
+/*
+ * Chunks: begin_chunk writes a chunk header of the given type and header
+ * size, leaving the header fields past struct arsc_chunk_header zeroed for
+ * the caller to fill in; end_chunk pads the chunk to 4 bytes and sets its
+ * size.
+ */
+static size_t begin_chunk(struct buffer *buf, uint16_t type,
+			  uint16_t header_size)
+{
+	size_t offset = buffer_append(buf, header_size);
+	struct arsc_chunk_header header = {
+		.type = dtohs(type),
+		.header_size = dtohs(header_size),
+	};
+
+	memcpy(buf->data + offset, &header, sizeof(header));
+	return offset;
+}
+
+static void end_chunk(struct buffer *buf, size_t offset)
+{
+	size_t size;
+
+	buffer_append(buf, (4 - buf->size % 4) % 4);
+	size = buf->size - offset;
+	die_if(size > UINT32_MAX, "chunk at offset %zd too large", offset);
+	patch32(buf, offset + offsetof(struct arsc_chunk_header, size), size);
+}
+
+/* deterministic stand-in for a random number generator */
+static uint32_t mix(uint32_t a, uint32_t b, uint32_t c)
+{
+	uint32_t h = a * 0x9e3779b1 ^ b * 0x85ebca77 ^ c * 0xc2b2ae3d;
+
+	h ^= h >> 15;
+	h *= 0x2c1b3c6d;
+	h ^= h >> 12;
+	return h;
+}
+
+typedef size_t (*string_fn)(uint32_t index, char *buf, size_t size);
+
+static void put_length8(struct buffer *buf, size_t len)
+{
+	uint8_t b[2] = { 0x80 | (len >> 8), len & 0xff };
+
+	if (len > 0x7f)
+		put(buf, b, 2);
+	else
+		put(buf, &b[1], 1);
+}
+
+/*
+ * Write a string pool of count strings, produced by str. Strings are
+ * ASCII, so their UTF-8 and UTF-16 lengths are the same.
+ */
+static void put_string_pool(struct buffer *buf, uint32_t count, string_fn str)
+{
+	size_t chunk, offsets, start;
+	char s[0x8000];
+	uint32_t i;
+
+	chunk = begin_chunk(buf, 0x0001, sizeof(struct arsc_string_pool));
+	offsets = buffer_append(buf, count * sizeof(uint32_t));
+	start = buf->size;
+	patch32(buf, chunk + offsetof(struct arsc_string_pool,
+				      data.string_count), count);
+	patch32(buf, chunk + offsetof(struct arsc_string_pool, data.flags),
+		gen_opts.utf16 ? 0 : ARSC_STRING_POOL_UTF8);
+	patch32(buf, chunk + offsetof(struct arsc_string_pool,
+				      data.strings_start), start - chunk);
+
+	for (i = 0; i < count; i++) {
+		size_t len = str(i, s, sizeof(s)), j;
+
+		patch32(buf, offsets + i * sizeof(uint32_t), buf->size - start);
+		if (gen_opts.utf16) {
+			put16(buf, len);
+			for (j = 0; j <= len; j++)
+				put16(buf, (uint8_t)s[j]);
+		} else {
+			put_length8(buf, len);
+			put_length8(buf, len);
+			put(buf, s, len + 1);
+		}
+	}
+	end_chunk(buf, chunk);
+}
+
+static const char *const type_names[] = {
+	"anim", "attr", "bool", "color", "dimen", "drawable", "id",
+	"integer", "layout", "menu", "raw", "string", "style", "xml",
+};
+
+#define TYPE_NAME_COUNT (sizeof(type_names) / sizeof(type_names[0]))
+
+static size_t type_name(uint32_t index, char *buf, size_t size)
+{
+	if (index < TYPE_NAME_COUNT)
+		return snprintf(buf, size, "%s", type_names[index]);
+	return snprintf(buf, size, "type%u", index + 1);
+}
+
+static size_t key_name(uint32_t index, char *buf, size_t size)
+{
+	return snprintf(buf, size, "entry%u", index);
+}
+
+static size_t value_string(uint32_t index, char *buf, size_t size)
+{
+	size_t len = snprintf(buf, size, "value%u-", index);
+
+	for (; len < (size_t)gen_opts.string_length; len++)
+		buf[len] = 'a' + mix(index, len, 0) % 26;
+	buf[len] = '\0';
+	return len;
+}
+
+/*
+ * Config i: the default config, then every two letter language, then
+ * the languages again with each density, then all of those with
+ * increasing sdk versions.
+ */
+static void make_config(uint32_t i, struct arsc_config *config)
+{
+	static const int densities[] = { 120, 160, 240, 320, 480, 640 };
+	char s[64];
+	int n;
+
+	if (i-- == 0) {
+		config_from_string("", config);
+		return;
+	}
+	n = snprintf(s, sizeof(s), "%c%c", 'a' + i % 26, 'a' + i / 26 % 26);
+	i /= 26 * 26;
+	if (i-- > 0) {
+		n += snprintf(s + n, sizeof(s) - n, "-%ddpi",
+			      densities[i % 6]);
+		if (i / 6)
+			snprintf(s + n, sizeof(s) - n, "-v%u", i / 6);
+	}
+	die_if(config_from_string(s, config), "bad generated config '%s'", s);
+}
+
+static int has_entry(uint32_t type, uint32_t config, uint32_t entry)
+{
+	return config == 0 ||
+		mix(type, config, entry) % 100 < (uint32_t)gen_opts.fill;
+}
+
+static void put_type_spec(struct buffer *buf, uint8_t id,
+			  const struct arsc_config *configs)
+{
+	size_t chunk = begin_chunk(buf, 0x0202, sizeof(struct arsc_type_spec));
+	uint32_t i, c;
+
+	buf->data[chunk + offsetof(struct arsc_type_spec, data.id)] = id;
+	patch32(buf, chunk + offsetof(struct arsc_type_spec,
+				      data.entry_count), gen_opts.entries);
+	for (i = 0; i < (uint32_t)gen_opts.entries; i++) {
+		uint32_t mask = 0;
+
+		for (c = 1; c < (uint32_t)gen_opts.configs; c++)
+			if (has_entry(id, c, i))
+				mask |= config_mask(&configs[c]);
+		put32(buf, mask);
+	}
+	end_chunk(buf, chunk);
+}
+
+static void put_entry(struct buffer *buf, uint8_t id, uint32_t config,
+		      uint32_t index)
+{
+	struct arsc_entry entry = {
+		.size = dtohs(sizeof(entry)),
+		.key = dtohl(index),
+	};
+	struct arsc_value value = { .size = dtohs(sizeof(value)) };
+
+	if (gen_opts.strings) {
+		value.data_type = ARSC_VALUE_TYPE_STRING;
+		value.data = dtohl(mix(id, config, index) % gen_opts.strings);
+	} else {
+		value.data_type = ARSC_VALUE_TYPE_INT_DEC;
+		value.data = dtohl(index);
+	}
+	put(buf, &entry, sizeof(entry));
+	put(buf, &value, sizeof(value));
+}
+
+#define ENTRY_SIZE (sizeof(struct arsc_entry) + sizeof(struct arsc_value))
+
+static void put_type(struct buffer *buf, uint8_t id, uint32_t c,
+		     const struct arsc_config *config)
+{
+	size_t header_size = offsetof(struct arsc_type, data.config) +
+		dtohl(config->size);
+	size_t chunk = begin_chunk(buf, 0x0201, header_size);
+	struct arsc_type *type;
+	uint32_t i, n = 0;
+
+	for (i = 0; i < (uint32_t)gen_opts.entries; i++)
+		n += has_entry(id, c, i);
+	die_if(gen_opts.sparse && n * ENTRY_SIZE / 4 > 0xffff,
+	       "too many entries for a sparse type: %u", n);
+
+	type = (struct arsc_type *)(buf->data + chunk);
+	type->data.id = id;
+	type->data.res0 = gen_opts.sparse ? ARSC_TYPE_FLAG_SPARSE : 0;
+	type->data.entry_count =
+		dtohl(gen_opts.sparse ? n : (uint32_t)gen_opts.entries);
+	memcpy(&type->data.config, config, dtohl(config->size));
+
+	for (i = 0, n = 0; i < (uint32_t)gen_opts.entries; i++) {
+		if (gen_opts.sparse) {
+			if (!has_entry(id, c, i))
+				continue;
+			put16(buf, i);
+			put16(buf, n++ * ENTRY_SIZE / 4);
+		} else {
+			put32(buf, has_entry(id, c, i) ?
+			      n++ * ENTRY_SIZE : ARSC_NO_ENTRY);
+		}
+	}
+	patch32(buf, chunk + offsetof(struct arsc_type, data.entries_start),
+		buf->size - chunk);
+
+	for (i = 0; i < (uint32_t)gen_opts.entries; i++)
+		if (has_entry(id, c, i))
+			put_entry(buf, id, c, i);
+	end_chunk(buf, chunk);
+}
+
+static void put_package(struct buffer *buf, uint32_t index,
+			const struct arsc_config *configs)
+{
+	size_t chunk = begin_chunk(buf, 0x0200, sizeof(struct arsc_package));
+	struct arsc_package *pkg;
+	char name[32];
+	uint32_t t, c;
+	size_t i, len;
+
+	pkg = (struct arsc_package *)(buf->data + chunk);
+	pkg->data.id = dtohl(0x7f - index);
+	len = snprintf(name, sizeof(name), "com.example.gen%u", index);
+	for (i = 0; i < len; i++)
+		pkg->data.name[i] = dtohs(name[i]);
+	pkg->data.type_strings = dtohl(buf->size - chunk);
+
+	put_string_pool(buf, gen_opts.types, type_name);
+	patch32(buf, chunk + offsetof(struct arsc_package, data.key_strings),
+		buf->size - chunk);
+	put_string_pool(buf, gen_opts.entries, key_name);
+
+	for (t = 1; t <= (uint32_t)gen_opts.types; t++) {
+		put_type_spec(buf, t, configs);
+		for (c = 0; c < (uint32_t)gen_opts.configs; c++)
+			put_type(buf, t, c, &configs[c]);
+	}
+	end_chunk(buf, chunk);
+}
+
+static void generate(struct buffer *buf)
+{
+	struct arsc_config *configs;
+	size_t chunk;
+	uint32_t i;
+
+	configs = xcalloc(gen_opts.configs, sizeof(*configs));
+	for (i = 0; i < (uint32_t)gen_opts.configs; i++) {
+		make_config(i, &configs[i]);
+		/* drop the qualifiers past the end of a shorter config */
+		memset((uint8_t *)&configs[i] + gen_opts.config_size, 0,
+		       sizeof(*configs) - gen_opts.config_size);
+		configs[i].size = dtohl(gen_opts.config_size);
+	}
+
+	chunk = begin_chunk(buf, 0x0002, sizeof(struct arsc_header));
+	patch32(buf, chunk + offsetof(struct arsc_header, data.package_count),
+		gen_opts.packages);
+	put_string_pool(buf, gen_opts.strings, value_string);
+	for (i = 0; i < (uint32_t)gen_opts.packages; i++)
+		put_package(buf, i, configs);
+	end_chunk(buf, chunk);
+
+	free(configs);
+}
+
+static void write_all(FILE *f, const void *data, size_t size,
+		      const char *path)
+{
+	die_if(fwrite(data, 1, size, f) != size, "%s: write failed", path);
+}
+
+#define ZIP_ENTRY_NAME "resources.arsc"
+#define ZIP_DOS_DATE_1980 0x0021 /* 1980-01-01, the earliest dos date */
+
+/*
+ * Wrap blob in a zip with a single stored entry, as aapt does for
+ * resources.arsc. The local header is sized so that the entry data is 4
+ * byte aligned. Zip64 is not needed: the blob header size is 32 bits.
+ */
+static void write_apk(FILE *f, const struct buffer *blob, const char *path)
+{
+	const uint16_t name_len = strlen(ZIP_ENTRY_NAME);
+	const uint16_t extra_len = (4 - (30 + name_len) % 4) % 4;
+	uint32_t crc = crc32(0, blob->data, blob->size);
+	struct buffer buf = { NULL, 0, 0 };
+	size_t cd_offset = 30 + name_len + extra_len + blob->size;
+
+	die_if(cd_offset > UINT32_MAX, "%s: too large for zip", path);
+
+	/* local file header */
+	put32(&buf, 0x04034b50);
+	put16(&buf, 10); /* version needed */
+	put16(&buf, 0); /* flags */
+	put16(&buf, 0); /* stored */
+	put16(&buf, 0); /* mtime */
+	put16(&buf, ZIP_DOS_DATE_1980);
+	put32(&buf, crc);
+	put32(&buf, blob->size);
+	put32(&buf, blob->size);
+	put16(&buf, name_len);
+	put16(&buf, extra_len);
+	put(&buf, ZIP_ENTRY_NAME, name_len);
+	buffer_append(&buf, extra_len);
+	write_all(f, buf.data, buf.size, path);
+	write_all(f, blob->data, blob->size, path);
+
+	/* central directory */
+	buf.size = 0;
+	put32(&buf, 0x02014b50);
+	put16(&buf, 10); /* version made by */
+	put16(&buf, 10); /* version needed */
+	put16(&buf, 0); /* flags */
+	put16(&buf, 0); /* stored */
+	put16(&buf, 0); /* mtime */
+	put16(&buf, ZIP_DOS_DATE_1980);
+	put32(&buf, crc);
+	put32(&buf, blob->size);
+	put32(&buf, blob->size);
+	put16(&buf, name_len);
+	put16(&buf, 0); /* extra length */
+	put16(&buf, 0); /* comment length */
+	put16(&buf, 0); /* disk */
+	put16(&buf, 0); /* internal attributes */
+	put32(&buf, 0); /* external attributes */
+	put32(&buf, 0); /* local header offset */
+	put(&buf, ZIP_ENTRY_NAME, name_len);
+
+	/* end of central directory */
+	put32(&buf, 0x06054b50);
+	put16(&buf, 0); /* disk */
+	put16(&buf, 0); /* central directory disk */
+	put16(&buf, 1); /* entries on this disk */
+	put16(&buf, 1); /* entries */
+	put32(&buf, 46 + name_len); /* central directory size */
+	put32(&buf, cd_offset);
+	put16(&buf, 0); /* comment length */
+	write_all(f, buf.data, buf.size, path);
+	free(buf.data);
+}
+
+int cmd_gen(int argc, char **argv)
+{
+	struct buffer buf = { NULL, 0, 0 };
+	const char *path;
+	FILE *f;
+
+	argc = parse_options(gen_option_specs, argc, argv);
+
+	die_if(argc != 1,
+	       "usage: arsc gen [--packages=<n>] [--types=<n>] "
+	       "[--configs=<n>] [--entries=<n>] [--strings=<n>] "
+	       "[--string-length=<n>] [--fill=<percent>] [--utf16] "
+	       "[--sparse] [--apk] [--config-size=<bytes>] <output-file>");
+	die_if(gen_opts.packages < 1 || gen_opts.packages > 0x7f,
+	       "--packages must be between 1 and 127");
+	die_if(gen_opts.types < 1 || gen_opts.types > 0xff,
+	       "--types must be between 1 and 255");
+	die_if(gen_opts.configs < 1, "--configs must be at least 1");
+	die_if(gen_opts.entries < 1 || gen_opts.entries > 0x10000,
+	       "--entries must be between 1 and 65536");
+	die_if(gen_opts.strings < 0, "--strings must not be negative");
+	die_if(gen_opts.string_length < 0 || gen_opts.string_length > 0x7f00,
+	       "--string-length must be between 0 and 32512");
+	die_if(gen_opts.fill < 0 || gen_opts.fill > 100,
+	       "--fill must be between 0 and 100");
+	die_if(gen_opts.config_size < 4 ||
+	       gen_opts.config_size > (int)sizeof(struct arsc_config) ||
+	       gen_opts.config_size % 4,
+	       "--config-size must be a multiple of 4 between 4 and %zu",
+	       sizeof(struct arsc_config));
+
+	generate(&buf);
+
+	path = argv[0];
+	f = fopen(path, "wb");
+	die_if(!f, "%s: failed to open for writing", path);
+	if (gen_opts.apk)
+		write_apk(f, &buf, path);
+	else
+		write_all(f, buf.data, buf.size, path);
+	die_if(fclose(f), "%s: write failed", path);
+
+	free(buf.data);
+	return 0;
+}
@@ -25,14 +25,16 @@ void __die(const char *file, unsigned int line, const char *func,
 
 /*
  * Functions to convert from device to host order.
- * Use dtohl for uint32_t, dtohs for uint16_t.
+ * Use dtohll for uint64_t, dtohl for uint32_t, dtohs for uint16_t.
  */
 #include <endian.h>
 #if __BYTE_ORDER == __LITTLE_ENDIAN
+# define dtohll(x) (x)
 # define dtohl(x) (x)
 # define dtohs(x) (x)
 #else
 # include <arpa/inet.h>
+# define dtohll(x) __builtin_bswap64(x)
 # define dtohl(x) htonl(x)
 # define dtohs(x) htons(x)
 #endif
@@ -1,4 +1,3 @@
-#include <stdarg.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -109,82 +108,156 @@ enum {
 	MASK_UI_MODE_NIGHT = 0x30,
 };
 
-static void append(char *buf, const char *fmt, ...)
+/*
+ * Output cursor for config_to_string. Each qualifier is written exactly
+ * once at the cursor position, preceded by a dash unless it is the first;
+ * the output is never re-scanned.
+ */
+struct cursor {
+	char *start;
+	char *p;
+};
+
+static inline void put_dash(struct cursor *cur)
 {
-	va_list ap;
-	size_t len = strlen(buf);
+	if (cur->p != cur->start)
+		*cur->p++ = '-';
+}
 
-	if (len > 0) {
-		strncat(buf, "-", CONFIG_LEN - 1);
-		len = strlen(buf);
-	}
-	va_start(ap, fmt);
-	vsnprintf(buf + len, CONFIG_LEN - len - 1, fmt, ap);
-	va_end(ap);
+static inline void put_raw(struct cursor *cur, const char *s, size_t len)
+{
+	memcpy(cur->p, s, len);
+	cur->p += len;
 }
 
-void config_to_string(const struct arsc_config *config, char buf[CONFIG_LEN])
+#define put(cur, s) \
+	do { \
+		put_dash(cur); \
+		put_raw((cur), (s), sizeof(s) - 1); \
+	} while (0)
+
+static void put_uint(struct cursor *cur, unsigned int n)
 {
-	uint16_t x;
+	char tmp[10];
+	size_t i = sizeof(tmp);
+
+	do {
+		tmp[--i] = '0' + n % 10;
+		n /= 10;
+	} while (n);
+	put_raw(cur, tmp + i, sizeof(tmp) - i);
+}
+
+/* prefix, decimal number, suffix: e.g. "sw" 600 "dp" */
+#define put_number(cur, prefix, n, suffix) \
+	do { \
+		put_dash(cur); \
+		put_raw((cur), (prefix), sizeof(prefix) - 1); \
+		put_uint((cur), (n)); \
+		put_raw((cur), (suffix), sizeof(suffix) - 1); \
+	} while (0)
+
+/* two character language or country code */
+static void put_code(struct cursor *cur, uint16_t code)
+{
+	put_dash(cur);
+	if (code & 0xff)
+		*cur->p++ = code & 0xff;
+	if (code >> 8)
+		*cur->p++ = code >> 8;
+}
+
+/*
+ * Copy config to out, with the fields past the end of an older, shorter
+ * config set to zero.
+ */
+static void read_config(const struct arsc_config *config,
+			struct arsc_config *out)
+{
+	size_t size = dtohl(config->size);
+
+	if (size > sizeof(*out))
+		size = sizeof(*out);
+	if (size < sizeof(out->size))
+		size = sizeof(out->size);
+	memset(out, 0, sizeof(*out));
+	memcpy(out, config, size);
+}
 
-	memset(buf, 0, CONFIG_LEN);
+/*
+ * Return config itself if it is complete, or else its copy in buf read by
+ * read_config. Type configs come straight from the file, and the bytes past
+ * an older, shorter config are not qualifiers (and may be past the blob).
+ */
+static const struct arsc_config *full_config(const struct arsc_config *config,
+					     struct arsc_config *buf)
+{
+	if (dtohl(config->size) >= sizeof(*config))
+		return config;
+	read_config(config, buf);
+	return buf;
+}
+
+/* config must be complete, as read by read_config */
+static size_t format_config(const struct arsc_config *config,
+			    char buf[CONFIG_LEN])
+{
+	struct cursor cur = { buf, buf };
+	uint16_t x;
 
 	/* imsi */
 	if (config->mcc)
-		append(buf, "mcc%d", dtohs(config->mcc));
+		put_number(&cur, "mcc", dtohs(config->mcc), "");
 	if (config->mnc)
-		append(buf, "mnc%d", dtohs(config->mnc));
+		put_number(&cur, "mnc", dtohs(config->mnc), "");
 
 	/* locale */
-	if (config->language) {
-		uint16_t l = dtohs(config->language);
-		append(buf, "%c%c", l & 0xff, (l >> 8) & 0xff);
-	}
-	if (config->country) {
-		uint16_t c = dtohs(config->country);
-		append(buf, "%c%c", c & 0xff, (c >> 8) & 0xff);
-	}
+	if (config->language)
+		put_code(&cur, dtohs(config->language));
+	if (config->country)
+		put_code(&cur, dtohs(config->country));
 
 	/* screen type */
 	x = dtohs(config->screen_layout) & MASK_LAYOUTDIR;
 	if (x != CONFIG_LAYOUTDIR_ANY) {
 		switch (x) {
 		case CONFIG_LAYOUTDIR_LTR << 6:
-			append(buf, "ldltr");
+			put(&cur, "ldltr");
 			break;
 		case CONFIG_LAYOUTDIR_RTL << 6:
-			append(buf, "ldrtl");
+			put(&cur, "ldrtl");
 			break;
 		}
 	}
 
 	/* screen size */
 	if (config->smallest_screen_width_dp)
-		append(buf, "sw%ddp", dtohs(config->smallest_screen_width_dp));
+		put_number(&cur, "sw", dtohs(config->smallest_screen_width_dp),
+			   "dp");
 
 	/* screen width */
 	if (config->screen_width_dp)
-		append(buf, "w%ddp", dtohs(config->screen_width_dp));
+		put_number(&cur, "w", dtohs(config->screen_width_dp), "dp");
 
 	/* screen height */
 	if (config->screen_height_dp)
-		append(buf, "h%ddp", dtohs(config->screen_height_dp));
+		put_number(&cur, "h", dtohs(config->screen_height_dp), "dp");
 
 	/* screen layout: screen size */
 	x = dtohs(config->screen_layout) & MASK_SCREENSIZE;
 	if (x != CONFIG_SCREENSIZE_ANY) {
 		switch (x) {
 		case CONFIG_SCREENSIZE_SMALL:
-			append(buf, "small");
+			put(&cur, "small");
 			break;
 		case CONFIG_SCREENSIZE_NORMAL:
-			append(buf, "normal");
+			put(&cur, "normal");
 			break;
 		case CONFIG_SCREENSIZE_LARGE:
-			append(buf, "large");
+			put(&cur, "large");
 			break;
 		case CONFIG_SCREENSIZE_XLARGE:
-			append(buf, "xlarge");
+			put(&cur, "xlarge");
 			break;
 		}
 	}
@@ -193,11 +266,11 @@ void config_to_string(const struct arsc_config *config, char buf[CONFIG_LEN])
 	x = dtohs(config->screen_layout) & MASK_SCREENLONG;
 	if (x != CONFIG_SCREENLONG_ANY) {
 		switch (x) {
-		case CONFIG_SCREENLONG_NO:
-			append(buf, "notlong");
+		case CONFIG_SCREENLONG_NO << 4:
+			put(&cur, "notlong");
 			break;
-		case CONFIG_SCREENLONG_YES:
-			append(buf, "long");
+		case CONFIG_SCREENLONG_YES << 4:
+			put(&cur, "long");
 			break;
 		}
 	}
@@ -206,13 +279,13 @@ void config_to_string(const struct arsc_config *config, char buf[CONFIG_LEN])
 	if (dtohs(config->orientation) != CONFIG_ORIENTATION_ANY) {
 		switch (dtohs(config->orientation)) {
 		case CONFIG_ORIENTATION_PORT:
-			append(buf, "port");
+			put(&cur, "port");
 			break;
 		case CONFIG_ORIENTATION_LAND:
-			append(buf, "land");
+			put(&cur, "land");
 			break;
 		case CONFIG_ORIENTATION_SQUARE:
-			append(buf, "square");
+			put(&cur, "square");
 			break;
 		}
 	}
@@ -222,16 +295,19 @@ void config_to_string(const struct arsc_config *config, char buf[CONFIG_LEN])
 	if (x != CONFIG_UI_MODE_TYPE_ANY) {
 		switch (x & MASK_UI_MODE_TYPE) {
 		case CONFIG_UI_MODE_TYPE_DESK:
-			append(buf, "desk");
+			put(&cur, "desk");
 			break;
 		case CONFIG_UI_MODE_TYPE_CAR:
-			append(buf, "car");
+			put(&cur, "car");
 			break;
 		case CONFIG_UI_MODE_TYPE_TELEVISION:
-			append(buf, "television");
+			put(&cur, "television");
 			break;
 		case CONFIG_UI_MODE_TYPE_APPLIANCE:
-			append(buf, "appliance");
+			put(&cur, "appliance");
+			break;
+		case CONFIG_UI_MODE_TYPE_WATCH:
+			put(&cur, "watch");
 			break;
 		}
 	}
@@ -240,11 +316,11 @@ void config_to_string(const struct arsc_config *config, char buf[CONFIG_LEN])
 	x = dtohs(config->ui_mode) & MASK_UI_MODE_NIGHT;
 	if (x != CONFIG_UI_MODE_NIGHT_ANY) {
 		switch (x) {
-		case CONFIG_UI_MODE_NIGHT_NO:
-			append(buf, "notnight");
+		case CONFIG_UI_MODE_NIGHT_NO << 4:
+			put(&cur, "notnight");
 			break;
-		case CONFIG_UI_MODE_NIGHT_YES:
-			append(buf, "night");
+		case CONFIG_UI_MODE_NIGHT_YES << 4:
+			put(&cur, "night");
 			break;
 		}
 	}
@@ -253,31 +329,31 @@ void config_to_string(const struct arsc_config *config, char buf[CONFIG_LEN])
 	if (dtohs(config->density) != CONFIG_DENSITY_DEFAULT) {
 		switch (dtohs(config->density)) {
 		case CONFIG_DENSITY_LOW:
-			append(buf, "ldpi");
+			put(&cur, "ldpi");
 			break;
 		case CONFIG_DENSITY_MEDIUM:
-			append(buf, "mdpi");
+			put(&cur, "mdpi");
 			break;
 		case CONFIG_DENSITY_TV:
-			append(buf, "tvdpi");
+			put(&cur, "tvdpi");
 			break;
 		case CONFIG_DENSITY_HIGH:
-			append(buf, "hdpi");
+			put(&cur, "hdpi");
 			break;
 		case CONFIG_DENSITY_XHIGH:
-			append(buf, "xhdpi");
+			put(&cur, "xhdpi");
 			break;
 		case CONFIG_DENSITY_XXHIGH:
-			append(buf, "xxhdpi");
+			put(&cur, "xxhdpi");
 			break;
 		case CONFIG_DENSITY_XXXHIGH:
-			append(buf, "xxxhdpi");
+			put(&cur, "xxxhdpi");
 			break;
 		case CONFIG_DENSITY_NONE:
-			append(buf, "nodpi");
+			put(&cur, "nodpi");
 			break;
 		case CONFIG_DENSITY_ANY:
-			append(buf, "anydpi");
+			put(&cur, "anydpi");
 			break;
 		}
 	}
@@ -286,13 +362,13 @@ void config_to_string(const struct arsc_config *config, char buf[CONFIG_LEN])
 	if (dtohs(config->touchscreen) != CONFIG_TOUCHSCREEN_ANY) {
 		switch (dtohs(config->touchscreen)) {
 		case CONFIG_TOUCHSCREEN_NOTOUCH:
-			append(buf, "notouch");
+			put(&cur, "notouch");
 			break;
 		case CONFIG_TOUCHSCREEN_FINGER:
-			append(buf, "finger");
+			put(&cur, "finger");
 			break;
 		case CONFIG_TOUCHSCREEN_STYLUS:
-			append(buf, "stylus");
+			put(&cur, "stylus");
 			break;
 		}
 	}
@@ -302,13 +378,13 @@ void config_to_string(const struct arsc_config *config, char buf[CONFIG_LEN])
 	if (x != CONFIG_KEYSHIDDEN_ANY) {
 		switch (x) {
 		case CONFIG_KEYSHIDDEN_NO:
-			append(buf, "keysexposed");
+			put(&cur, "keysexposed");
 			break;
 		case CONFIG_KEYSHIDDEN_YES:
-			append(buf, "keyshidden");
+			put(&cur, "keyshidden");
 			break;
 		case CONFIG_KEYSHIDDEN_SOFT:
-			append(buf, "keyssoft");
+			put(&cur, "keyssoft");
 			break;
 		}
 	}
@@ -317,13 +393,13 @@ void config_to_string(const struct arsc_config *config, char buf[CONFIG_LEN])
 	if (dtohs(config->keyboard) != CONFIG_KEYBOARD_ANY) {
 		switch (dtohs(config->keyboard)) {
 		case CONFIG_KEYBOARD_NOKEYS:
-			append(buf, "nokeys");
+			put(&cur, "nokeys");
 			break;
 		case CONFIG_KEYBOARD_QWERTY:
-			append(buf, "qwerty");
+			put(&cur, "qwerty");
 			break;
 		case CONFIG_KEYBOARD_12KEY:
-			append(buf, "12key");
+			put(&cur, "12key");
 			break;
 		}
 	}
@@ -332,11 +408,11 @@ void config_to_string(const struct arsc_config *config, char buf[CONFIG_LEN])
 	x = dtohs(config->input_flags) & MASK_NAVHIDDEN;
 	if (x != CONFIG_NAVHIDDEN_ANY) {
 		switch (x) {
-		case CONFIG_NAVHIDDEN_NO:
-			append(buf, "navexposed");
+		case CONFIG_NAVHIDDEN_NO << 2:
+			put(&cur, "navexposed");
 			break;
-		case CONFIG_NAVHIDDEN_YES:
-			append(buf, "navhidden");
+		case CONFIG_NAVHIDDEN_YES << 2:
+			put(&cur, "navhidden");
 			break;
 		}
 	}
@@ -345,21 +421,787 @@ void config_to_string(const struct arsc_config *config, char buf[CONFIG_LEN])
 	if (dtohs(config->navigation) != CONFIG_NAVIGATION_ANY) {
 		switch (dtohs(config->navigation)) {
 		case CONFIG_NAVIGATION_NONAV:
-			append(buf, "nonav");
+			put(&cur, "nonav");
 			break;
 		case CONFIG_NAVIGATION_DPAD:
-			append(buf, "dpad");
+			put(&cur, "dpad");
 			break;
 		case CONFIG_NAVIGATION_TRACKBALL:
-			append(buf, "trackball");
+			put(&cur, "trackball");
 			break;
 		case CONFIG_NAVIGATION_WHEEL:
-			append(buf, "wheel");
+			put(&cur, "wheel");
 			break;
 		}
 	}
 
+	/* version */
+	if (config->sdk_version)
+		put_number(&cur, "v", dtohs(config->sdk_version), "");
+
 	/* default config (all fields 0) */
-	if (strlen(buf) == 0)
-		strcpy(buf, "-");
+	if (cur.p == buf)
+		put_raw(&cur, "-", 1);
+	*cur.p = '\0';
+	return cur.p - buf;
+}
+
+size_t config_to_string(const struct arsc_config *config, char buf[CONFIG_LEN])
+{
+	struct arsc_config copy;
+
+	read_config(config, &copy);
+	return format_config(&copy, buf);
+}
+
+/*
+ * Qualifier names for the enum valued config fields, used by
+ * config_from_string. Each name sets its bits within one field.
+ */
+enum qualifier_field {
+	FIELD_ORIENTATION,
+	FIELD_TOUCHSCREEN,
+	FIELD_DENSITY,
+	FIELD_KEYBOARD,
+	FIELD_NAVIGATION,
+	FIELD_INPUT_FLAGS,
+	FIELD_SCREEN_LAYOUT,
+	FIELD_UI_MODE,
+};
+
+static const struct qualifier {
+	const char *name;
+	enum qualifier_field field;
+	uint16_t mask;
+	uint16_t value;
+} qualifiers[] = {
+	{ "ldltr", FIELD_SCREEN_LAYOUT, MASK_LAYOUTDIR,
+	  CONFIG_LAYOUTDIR_LTR << 6 },
+	{ "ldrtl", FIELD_SCREEN_LAYOUT, MASK_LAYOUTDIR,
+	  CONFIG_LAYOUTDIR_RTL << 6 },
+	{ "small", FIELD_SCREEN_LAYOUT, MASK_SCREENSIZE,
+	  CONFIG_SCREENSIZE_SMALL },
+	{ "normal", FIELD_SCREEN_LAYOUT, MASK_SCREENSIZE,
+	  CONFIG_SCREENSIZE_NORMAL },
+	{ "large", FIELD_SCREEN_LAYOUT, MASK_SCREENSIZE,
+	  CONFIG_SCREENSIZE_LARGE },
+	{ "xlarge", FIELD_SCREEN_LAYOUT, MASK_SCREENSIZE,
+	  CONFIG_SCREENSIZE_XLARGE },
+	{ "notlong", FIELD_SCREEN_LAYOUT, MASK_SCREENLONG,
+	  CONFIG_SCREENLONG_NO << 4 },
+	{ "long", FIELD_SCREEN_LAYOUT, MASK_SCREENLONG,
+	  CONFIG_SCREENLONG_YES << 4 },
+	{ "port", FIELD_ORIENTATION, 0xff, CONFIG_ORIENTATION_PORT },
+	{ "land", FIELD_ORIENTATION, 0xff, CONFIG_ORIENTATION_LAND },
+	{ "square", FIELD_ORIENTATION, 0xff, CONFIG_ORIENTATION_SQUARE },
+	{ "desk", FIELD_UI_MODE, MASK_UI_MODE_TYPE, CONFIG_UI_MODE_TYPE_DESK },
+	{ "car", FIELD_UI_MODE, MASK_UI_MODE_TYPE, CONFIG_UI_MODE_TYPE_CAR },
+	{ "television", FIELD_UI_MODE, MASK_UI_MODE_TYPE,
+	  CONFIG_UI_MODE_TYPE_TELEVISION },
+	{ "appliance", FIELD_UI_MODE, MASK_UI_MODE_TYPE,
+	  CONFIG_UI_MODE_TYPE_APPLIANCE },
+	{ "watch", FIELD_UI_MODE, MASK_UI_MODE_TYPE,
+	  CONFIG_UI_MODE_TYPE_WATCH },
+	{ "notnight", FIELD_UI_MODE, MASK_UI_MODE_NIGHT,
+	  CONFIG_UI_MODE_NIGHT_NO << 4 },
+	{ "night", FIELD_UI_MODE, MASK_UI_MODE_NIGHT,
+	  CONFIG_UI_MODE_NIGHT_YES << 4 },
+	{ "ldpi", FIELD_DENSITY, 0xffff, CONFIG_DENSITY_LOW },
+	{ "mdpi", FIELD_DENSITY, 0xffff, CONFIG_DENSITY_MEDIUM },
+	{ "tvdpi", FIELD_DENSITY, 0xffff, CONFIG_DENSITY_TV },
+	{ "hdpi", FIELD_DENSITY, 0xffff, CONFIG_DENSITY_HIGH },
+	{ "xhdpi", FIELD_DENSITY, 0xffff, CONFIG_DENSITY_XHIGH },
+	{ "xxhdpi", FIELD_DENSITY, 0xffff, CONFIG_DENSITY_XXHIGH },
+	{ "xxxhdpi", FIELD_DENSITY, 0xffff, CONFIG_DENSITY_XXXHIGH },
+	{ "nodpi", FIELD_DENSITY, 0xffff, CONFIG_DENSITY_NONE },
+	{ "anydpi", FIELD_DENSITY, 0xffff, CONFIG_DENSITY_ANY },
+	{ "notouch", FIELD_TOUCHSCREEN, 0xff, CONFIG_TOUCHSCREEN_NOTOUCH },
+	{ "finger", FIELD_TOUCHSCREEN, 0xff, CONFIG_TOUCHSCREEN_FINGER },
+	{ "stylus", FIELD_TOUCHSCREEN, 0xff, CONFIG_TOUCHSCREEN_STYLUS },
+	{ "keysexposed", FIELD_INPUT_FLAGS, MASK_KEYSHIDDEN,
+	  CONFIG_KEYSHIDDEN_NO },
+	{ "keyshidden", FIELD_INPUT_FLAGS, MASK_KEYSHIDDEN,
+	  CONFIG_KEYSHIDDEN_YES },
+	{ "keyssoft", FIELD_INPUT_FLAGS, MASK_KEYSHIDDEN,
+	  CONFIG_KEYSHIDDEN_SOFT },
+	{ "nokeys", FIELD_KEYBOARD, 0xff, CONFIG_KEYBOARD_NOKEYS },
+	{ "qwerty", FIELD_KEYBOARD, 0xff, CONFIG_KEYBOARD_QWERTY },
+	{ "12key", FIELD_KEYBOARD, 0xff, CONFIG_KEYBOARD_12KEY },
+	{ "navexposed", FIELD_INPUT_FLAGS, MASK_NAVHIDDEN,
+	  CONFIG_NAVHIDDEN_NO << 2 },
+	{ "navhidden", FIELD_INPUT_FLAGS, MASK_NAVHIDDEN,
+	  CONFIG_NAVHIDDEN_YES << 2 },
+	{ "nonav", FIELD_NAVIGATION, 0xff, CONFIG_NAVIGATION_NONAV },
+	{ "dpad", FIELD_NAVIGATION, 0xff, CONFIG_NAVIGATION_DPAD },
+	{ "trackball", FIELD_NAVIGATION, 0xff, CONFIG_NAVIGATION_TRACKBALL },
+	{ "wheel", FIELD_NAVIGATION, 0xff, CONFIG_NAVIGATION_WHEEL },
+};
+
+static void set_qualifier(struct arsc_config *config,
+			  const struct qualifier *q)
+{
+	switch (q->field) {
+	case FIELD_ORIENTATION:
+		config->orientation = q->value;
+		break;
+	case FIELD_TOUCHSCREEN:
+		config->touchscreen = q->value;
+		break;
+	case FIELD_DENSITY:
+		config->density = dtohs(q->value);
+		break;
+	case FIELD_KEYBOARD:
+		config->keyboard = q->value;
+		break;
+	case FIELD_NAVIGATION:
+		config->navigation = q->value;
+		break;
+	case FIELD_INPUT_FLAGS:
+		config->input_flags = (config->input_flags & ~q->mask) |
+			q->value;
+		break;
+	case FIELD_SCREEN_LAYOUT:
+		config->screen_layout = (config->screen_layout & ~q->mask) |
+			q->value;
+		break;
+	case FIELD_UI_MODE:
+		config->ui_mode = (config->ui_mode & ~q->mask) | q->value;
+		break;
+	}
+}
+
+/*
+ * If s (of length len) is prefix, a decimal number and suffix, store the
+ * number in *n and return 1; otherwise return 0.
+ */
+static int parse_number(const char *s, size_t len, const char *prefix,
+			const char *suffix, uint16_t *n)
+{
+	size_t prefix_len = strlen(prefix), suffix_len = strlen(suffix);
+	uint32_t v = 0;
+	size_t i;
+
+	if (len <= prefix_len + suffix_len ||
+	    memcmp(s, prefix, prefix_len) ||
+	    memcmp(s + len - suffix_len, suffix, suffix_len))
+		return 0;
+	for (i = prefix_len; i < len - suffix_len; i++) {
+		if (s[i] < '0' || s[i] > '9')
+			return 0;
+		v = v * 10 + s[i] - '0';
+		if (v > 0xffff)
+			return 0;
+	}
+	*n = v;
+	return 1;
+}
+
+static inline int is_lower(char c)
+{
+	return c >= 'a' && c <= 'z';
+}
+
+static inline int is_upper(char c)
+{
+	return c >= 'A' && c <= 'Z';
+}
+
+static int parse_qualifier(struct arsc_config *config, const char *s,
+			   size_t len)
+{
+	uint16_t n, m;
+	size_t i;
+
+	if (len == 2 && is_lower(s[0]) && is_lower(s[1])) {
+		config->language = dtohs(s[0] | s[1] << 8);
+		return 0;
+	}
+	/* "rUS", or "US" as config_to_string prints it */
+	if (len == 3 && s[0] == 'r' && is_upper(s[1]) && is_upper(s[2])) {
+		config->country = dtohs(s[1] | s[2] << 8);
+		return 0;
+	}
+	if (len == 2 && is_upper(s[0]) && is_upper(s[1])) {
+		config->country = dtohs(s[0] | s[1] << 8);
+		return 0;
+	}
+
+	for (i = 0; i < sizeof(qualifiers) / sizeof(qualifiers[0]); i++) {
+		const struct qualifier *q = &qualifiers[i];
+
+		if (!strncmp(q->name, s, len) && q->name[len] == '\0') {
+			set_qualifier(config, q);
+			return 0;
+		}
+	}
+
+	if (parse_number(s, len, "mcc", "", &n)) {
+		config->mcc = dtohs(n);
+	} else if (parse_number(s, len, "mnc", "", &n)) {
+		config->mnc = dtohs(n);
+	} else if (parse_number(s, len, "sw", "dp", &n)) {
+		config->smallest_screen_width_dp = dtohs(n);
+	} else if (parse_number(s, len, "w", "dp", &n)) {
+		config->screen_width_dp = dtohs(n);
+	} else if (parse_number(s, len, "h", "dp", &n)) {
+		config->screen_height_dp = dtohs(n);
+	} else if (parse_number(s, len, "v", "", &n)) {
+		config->sdk_version = dtohs(n);
+	} else if (parse_number(s, len, "", "dpi", &n)) {
+		config->density = dtohs(n);
+	} else {
+		/* screen size in pixels: <width>x<height> */
+		const char *x = memchr(s, 'x', len);
+
+		if (!x || !parse_number(s, x - s, "", "", &n) ||
+		    !parse_number(x + 1, s + len - x - 1, "", "", &m))
+			return -1;
+		config->screen_width = dtohs(n > m ? n : m);
+		config->screen_height = dtohs(n > m ? m : n);
+	}
+	return 0;
+}
+
+int config_from_string(const char *s, struct arsc_config *config)
+{
+	memset(config, 0, sizeof(*config));
+	config->size = dtohl(sizeof(*config));
+
+	/* default config */
+	if (!strcmp(s, "-") || !strcmp(s, ""))
+		return 0;
+
+	for (;;) {
+		const char *end = strchr(s, '-');
+		size_t len = end ? (size_t)(end - s) : strlen(s);
+
+		/* no empty qualifiers: leading, trailing or double dashes */
+		if (len == 0 || parse_qualifier(config, s, len))
+			return -1;
+		if (!end)
+			return 0;
+		s = end + 1;
+	}
+}
+
+void config_filter_init(struct config_filter *filter,
+			const struct arsc_config *config)
+{
+	const struct arsc_config *c = config;
+	struct arsc_config *m = &filter->mask;
+
+	memset(m, 0, sizeof(*m));
+	m->mcc = c->mcc ? 0xffff : 0;
+	m->mnc = c->mnc ? 0xffff : 0;
+	m->language = c->language ? 0xffff : 0;
+	m->country = c->country ? 0xffff : 0;
+	m->orientation = c->orientation ? 0xff : 0;
+	m->touchscreen = c->touchscreen ? 0xff : 0;
+	m->density = c->density ? 0xffff : 0;
+	m->keyboard = c->keyboard ? 0xff : 0;
+	m->navigation = c->navigation ? 0xff : 0;
+	if (c->input_flags & MASK_KEYSHIDDEN)
+		m->input_flags |= MASK_KEYSHIDDEN;
+	if (c->input_flags & MASK_NAVHIDDEN)
+		m->input_flags |= MASK_NAVHIDDEN;
+	m->screen_width = c->screen_width ? 0xffff : 0;
+	m->screen_height = c->screen_height ? 0xffff : 0;
+	m->sdk_version = c->sdk_version ? 0xffff : 0;
+	m->minor_version = c->minor_version ? 0xffff : 0;
+	if (c->screen_layout & MASK_SCREENSIZE)
+		m->screen_layout |= MASK_SCREENSIZE;
+	if (c->screen_layout & MASK_SCREENLONG)
+		m->screen_layout |= MASK_SCREENLONG;
+	if (c->screen_layout & MASK_LAYOUTDIR)
+		m->screen_layout |= MASK_LAYOUTDIR;
+	if (c->ui_mode & MASK_UI_MODE_TYPE)
+		m->ui_mode |= MASK_UI_MODE_TYPE;
+	if (c->ui_mode & MASK_UI_MODE_NIGHT)
+		m->ui_mode |= MASK_UI_MODE_NIGHT;
+	m->smallest_screen_width_dp = c->smallest_screen_width_dp ? 0xffff : 0;
+	m->screen_width_dp = c->screen_width_dp ? 0xffff : 0;
+	m->screen_height_dp = c->screen_height_dp ? 0xffff : 0;
+
+	filter->value = *config;
+	filter->value.size = 0;
+}
+
+int config_filter_match(const struct config_filter *filter,
+			const struct arsc_config *config)
+{
+	const uint8_t *value = (const uint8_t *)&filter->value;
+	const uint8_t *mask = (const uint8_t *)&filter->mask;
+	const uint8_t *p = (const uint8_t *)config;
+	size_t size = dtohl(config->size);
+	size_t i;
+
+	/* fields past the end of an older, shorter config read as zero */
+	if (size > sizeof(*config))
+		size = sizeof(*config);
+	for (i = offsetof(struct arsc_config, mcc); i < sizeof(*config); i++) {
+		uint8_t x = i < size ? p[i] : 0;
+
+		if ((x & mask[i]) != value[i])
+			return 0;
+	}
+	return 1;
+}
+
+int config_compare(const struct arsc_config *a, const struct arsc_config *b)
+{
+	size_t offset = offsetof(struct arsc_config, mcc);
+	struct arsc_config abuf, bbuf;
+
+	a = full_config(a, &abuf);
+	b = full_config(b, &bbuf);
+	return memcmp((const uint8_t *)a + offset, (const uint8_t *)b + offset,
+		      sizeof(*a) - offset);
+}
+
+/*
+ * The cache is an open addressing hash table from the config bytes that
+ * config_to_string reads (everything after the size field, zero padded as
+ * by read_config) to a string stored in a chunk of a string arena.
+ */
+#define CONFIG_KEY_OFFSET offsetof(struct arsc_config, mcc)
+#define CONFIG_KEY_SIZE (sizeof(struct arsc_config) - CONFIG_KEY_OFFSET)
+#define CONFIG_CACHE_CHUNK_SIZE (16 * 1024)
+
+struct config_cache_slot {
+	uint32_t hash;
+	uint32_t len;
+	const char *str; /* NULL means empty */
+	uint8_t key[CONFIG_KEY_SIZE];
+};
+
+struct config_cache_chunk {
+	struct config_cache_chunk *next;
+	size_t used;
+	char data[CONFIG_CACHE_CHUNK_SIZE];
+};
+
+struct config_cache {
+	struct config_cache_slot *slots;
+	size_t mask;
+	size_t count;
+	struct config_cache_chunk *chunks;
+};
+
+struct config_cache *config_cache_create(void)
+{
+	struct config_cache *cache = xmalloc(sizeof(*cache));
+
+	cache->mask = 63;
+	cache->slots = xcalloc(cache->mask + 1, sizeof(*cache->slots));
+	cache->count = 0;
+	cache->chunks = NULL;
+	return cache;
+}
+
+void config_cache_destroy(struct config_cache *cache)
+{
+	while (cache->chunks) {
+		struct config_cache_chunk *next = cache->chunks->next;
+
+		free(cache->chunks);
+		cache->chunks = next;
+	}
+	free(cache->slots);
+	free(cache);
+}
+
+static uint32_t hash_key(const uint8_t *key)
+{
+	uint32_t h = 2166136261u;
+	size_t i;
+
+	for (i = 0; i < CONFIG_KEY_SIZE; i++) {
+		h ^= key[i];
+		h *= 16777619u;
+	}
+	return h;
+}
+
+static const char *intern(struct config_cache *cache, const char *s,
+			  size_t len)
+{
+	struct config_cache_chunk *chunk = cache->chunks;
+	char *p;
+
+	if (!chunk || chunk->used + len + 1 > sizeof(chunk->data)) {
+		chunk = xmalloc(sizeof(*chunk));
+		chunk->next = cache->chunks;
+		chunk->used = 0;
+		cache->chunks = chunk;
+	}
+	p = chunk->data + chunk->used;
+	memcpy(p, s, len + 1);
+	chunk->used += len + 1;
+	return p;
+}
+
+static void grow(struct config_cache *cache)
+{
+	struct config_cache_slot *old = cache->slots;
+	size_t i, old_size = cache->mask + 1;
+
+	cache->mask = 2 * old_size - 1;
+	cache->slots = xcalloc(cache->mask + 1, sizeof(*cache->slots));
+	for (i = 0; i < old_size; i++) {
+		size_t j;
+
+		if (!old[i].str)
+			continue;
+		for (j = old[i].hash & cache->mask; cache->slots[j].str;
+		     j = (j + 1) & cache->mask)
+			;
+		cache->slots[j] = old[i];
+	}
+	free(old);
+}
+
+const char *config_cache_string(struct config_cache *cache,
+				const struct arsc_config *config,
+				size_t *len)
+{
+	struct arsc_config copy;
+	const uint8_t *key = (const uint8_t *)&copy + CONFIG_KEY_OFFSET;
+	struct config_cache_slot *slot;
+	char buf[CONFIG_LEN];
+	uint32_t h;
+	size_t j;
+
+	/* only the bytes config->size covers are part of the key */
+	read_config(config, &copy);
+	h = hash_key(key);
+	for (j = h & cache->mask; cache->slots[j].str;
+	     j = (j + 1) & cache->mask) {
+		slot = &cache->slots[j];
+		if (slot->hash == h &&
+		    !memcmp(slot->key, key, CONFIG_KEY_SIZE)) {
+			*len = slot->len;
+			return slot->str;
+		}
+	}
+
+	/* keep the load factor at or below 1/2 */
+	if (2 * (cache->count + 1) > cache->mask + 1) {
+		grow(cache);
+		for (j = h & cache->mask; cache->slots[j].str;
+		     j = (j + 1) & cache->mask)
+			;
+	}
+	slot = &cache->slots[j];
+	slot->hash = h;
+	memcpy(slot->key, key, CONFIG_KEY_SIZE);
+	slot->len = format_config(&copy, buf);
+	slot->str = intern(cache, buf, slot->len);
+	cache->count++;
+	*len = slot->len;
+	return slot->str;
+}
+
+uint32_t config_mask(const struct arsc_config *config)
+{
+	struct arsc_config buf;
+	uint32_t mask = 0;
+
+	config = full_config(config, &buf);
+
+	if (config->mcc)
+		mask |= CONFIG_MCC;
+	if (config->mnc)
+		mask |= CONFIG_MNC;
+	if (config->language || config->country)
+		mask |= CONFIG_LOCALE;
+	if (config->screen_layout & MASK_LAYOUTDIR)
+		mask |= CONFIG_LAYOUTDIR;
+	if (config->smallest_screen_width_dp)
+		mask |= CONFIG_SMALLEST_SCREEN_SIZE;
+	if (config->screen_width_dp || config->screen_height_dp ||
+	    config->screen_width || config->screen_height)
+		mask |= CONFIG_SCREEN_SIZE;
+	if (config->screen_layout & (MASK_SCREENSIZE | MASK_SCREENLONG))
+		mask |= CONFIG_SCREEN_LAYOUT;
+	if (config->orientation)
+		mask |= CONFIG_ORIENTATION;
+	if (config->ui_mode)
+		mask |= CONFIG_UI_MODE;
+	if (config->density)
+		mask |= CONFIG_DENSITY;
+	if (config->touchscreen)
+		mask |= CONFIG_TOUCHSCREEN;
+	if (config->input_flags & (MASK_KEYSHIDDEN | MASK_NAVHIDDEN))
+		mask |= CONFIG_KEYBOARD_HIDDEN;
+	if (config->keyboard)
+		mask |= CONFIG_KEYBOARD;
+	if (config->navigation)
+		mask |= CONFIG_NAVIGATION;
+	if (config->sdk_version || config->minor_version)
+		mask |= CONFIG_VERSION;
+
+	return mask;
+}
+
+/*
+ * Port of ResTable_config::match. Only the qualifiers in mask (the
+ * config's own config_mask) are inspected.
+ */
+int config_match(const struct arsc_config *config, uint32_t mask,
+		 const struct arsc_config *target)
+{
+	struct arsc_config buf;
+	uint8_t x;
+
+	config = full_config(config, &buf);
+
+	if (mask & CONFIG_MCC && config->mcc != target->mcc)
+		return 0;
+	if (mask & CONFIG_MNC && config->mnc != target->mnc)
+		return 0;
+	if (mask & CONFIG_LOCALE) {
+		if (config->language && config->language != target->language)
+			return 0;
+		if (config->country && config->country != target->country)
+			return 0;
+	}
+	if (mask & CONFIG_LAYOUTDIR &&
+	    (config->screen_layout & MASK_LAYOUTDIR) !=
+	    (target->screen_layout & MASK_LAYOUTDIR))
+		return 0;
+	if (mask & CONFIG_SCREEN_LAYOUT) {
+		x = config->screen_layout & MASK_SCREENSIZE;
+		/* larger screen sizes than the target do not match */
+		if (x && x > (target->screen_layout & MASK_SCREENSIZE))
+			return 0;
+		x = config->screen_layout & MASK_SCREENLONG;
+		if (x && x != (target->screen_layout & MASK_SCREENLONG))
+			return 0;
+	}
+	if (mask & CONFIG_UI_MODE) {
+		x = config->ui_mode & MASK_UI_MODE_TYPE;
+		if (x && x != (target->ui_mode & MASK_UI_MODE_TYPE))
+			return 0;
+		x = config->ui_mode & MASK_UI_MODE_NIGHT;
+		if (x && x != (target->ui_mode & MASK_UI_MODE_NIGHT))
+			return 0;
+	}
+	if (mask & CONFIG_SMALLEST_SCREEN_SIZE &&
+	    dtohs(config->smallest_screen_width_dp) >
+	    dtohs(target->smallest_screen_width_dp))
+		return 0;
+	if (mask & CONFIG_SCREEN_SIZE) {
+		if (dtohs(config->screen_width_dp) >
+		    dtohs(target->screen_width_dp))
+			return 0;
+		if (dtohs(config->screen_height_dp) >
+		    dtohs(target->screen_height_dp))
+			return 0;
+		if (dtohs(config->screen_width) > dtohs(target->screen_width))
+			return 0;
+		if (dtohs(config->screen_height) >
+		    dtohs(target->screen_height))
+			return 0;
+	}
+	if (mask & CONFIG_ORIENTATION &&
+	    config->orientation != target->orientation)
+		return 0;
+	if (mask & CONFIG_TOUCHSCREEN &&
+	    config->touchscreen != target->touchscreen)
+		return 0;
+	if (mask & CONFIG_KEYBOARD_HIDDEN) {
+		uint8_t y = target->input_flags & MASK_KEYSHIDDEN;
+
+		x = config->input_flags & MASK_KEYSHIDDEN;
+		/* for compatibility, KEYSHIDDEN_NO matches KEYSHIDDEN_SOFT */
+		if (x && x != y &&
+		    (x != CONFIG_KEYSHIDDEN_NO || y != CONFIG_KEYSHIDDEN_SOFT))
+			return 0;
+		x = config->input_flags & MASK_NAVHIDDEN;
+		if (x && x != (target->input_flags & MASK_NAVHIDDEN))
+			return 0;
+	}
+	if (mask & CONFIG_KEYBOARD && config->keyboard != target->keyboard)
+		return 0;
+	if (mask & CONFIG_NAVIGATION &&
+	    config->navigation != target->navigation)
+		return 0;
+	if (mask & CONFIG_VERSION) {
+		if (dtohs(config->sdk_version) > dtohs(target->sdk_version))
+			return 0;
+		if (config->minor_version &&
+		    config->minor_version != target->minor_version)
+			return 0;
+	}
+	return 1;
+}
+
+static int density_is_better(uint16_t a, uint16_t b, uint16_t target)
+{
+	int h, l, t = target;
+	int a_is_bigger = 1;
+
+	/* the system default density is used if none is specified */
+	h = a ? a : CONFIG_DENSITY_MEDIUM;
+	l = b ? b : CONFIG_DENSITY_MEDIUM;
+	if (t == 0 || t == CONFIG_DENSITY_ANY)
+		t = CONFIG_DENSITY_MEDIUM;
+
+	/* always prefer DENSITY_ANY over scaling a density bucket */
+	if (h == CONFIG_DENSITY_ANY)
+		return 1;
+	if (l == CONFIG_DENSITY_ANY)
+		return 0;
+
+	if (l > h) {
+		int tmp = h;
+		h = l;
+		l = tmp;
+		a_is_bigger = 0;
+	}
+	if (t >= h)
+		return a_is_bigger;
+	if (l >= t)
+		return !a_is_bigger;
+	/* scaling down is considered twice as good as scaling up */
+	if ((2 * l - t) * h > t * t)
+		return !a_is_bigger;
+	return a_is_bigger;
+}
+
+/*
+ * Port of ResTable_config::isBetterThan, for two configs that both match
+ * target. Qualifiers outside mask (the union of the config_mask of every
+ * candidate) are known to be unset in both configs and are skipped.
+ */
+int config_is_better(const struct arsc_config *a, const struct arsc_config *b,
+		     uint32_t mask, const struct arsc_config *target)
+{
+	struct arsc_config abuf, bbuf;
+	uint8_t x, y, t;
+
+	a = full_config(a, &abuf);
+	b = full_config(b, &bbuf);
+
+	if (mask & CONFIG_MCC && a->mcc != b->mcc && target->mcc)
+		return a->mcc != 0;
+	if (mask & CONFIG_MNC && a->mnc != b->mnc && target->mnc)
+		return a->mnc != 0;
+	if (mask & CONFIG_LOCALE && target->language) {
+		if (a->language != b->language)
+			return a->language != 0;
+		if (a->country != b->country && target->country)
+			return a->country != 0;
+	}
+	if (mask & CONFIG_LAYOUTDIR) {
+		x = a->screen_layout & MASK_LAYOUTDIR;
+		y = b->screen_layout & MASK_LAYOUTDIR;
+		if (x != y && target->screen_layout & MASK_LAYOUTDIR)
+			return x > y;
+	}
+	if (mask & CONFIG_SMALLEST_SCREEN_SIZE &&
+	    a->smallest_screen_width_dp != b->smallest_screen_width_dp)
+		return dtohs(a->smallest_screen_width_dp) >
+			dtohs(b->smallest_screen_width_dp);
+	if (mask & CONFIG_SCREEN_SIZE) {
+		int da = 0, db = 0;
+
+		if (target->screen_width_dp) {
+			da -= dtohs(a->screen_width_dp);
+			db -= dtohs(b->screen_width_dp);
+		}
+		if (target->screen_height_dp) {
+			da -= dtohs(a->screen_height_dp);
+			db -= dtohs(b->screen_height_dp);
+		}
+		if (da != db)
+			return da < db;
+	}
+	if (mask & CONFIG_SCREEN_LAYOUT) {
+		x = a->screen_layout & MASK_SCREENSIZE;
+		y = b->screen_layout & MASK_SCREENSIZE;
+		t = target->screen_layout & MASK_SCREENSIZE;
+		if (x != y && t) {
+			uint8_t fx = x, fy = y;
+
+			if (t >= CONFIG_SCREENSIZE_NORMAL) {
+				fx = fx ? fx : CONFIG_SCREENSIZE_NORMAL;
+				fy = fy ? fy : CONFIG_SCREENSIZE_NORMAL;
+			}
+			if (fx == fy)
+				return x != 0;
+			return fx > fy;
+		}
+		x = a->screen_layout & MASK_SCREENLONG;
+		y = b->screen_layout & MASK_SCREENLONG;
+		if (x != y && target->screen_layout & MASK_SCREENLONG)
+			return x != 0;
+	}
+	if (mask & CONFIG_ORIENTATION && a->orientation != b->orientation &&
+	    target->orientation)
+		return a->orientation != 0;
+	if (mask & CONFIG_UI_MODE) {
+		x = a->ui_mode & MASK_UI_MODE_TYPE;
+		y = b->ui_mode & MASK_UI_MODE_TYPE;
+		if (x != y && target->ui_mode & MASK_UI_MODE_TYPE)
+			return x != 0;
+		x = a->ui_mode & MASK_UI_MODE_NIGHT;
+		y = b->ui_mode & MASK_UI_MODE_NIGHT;
+		if (x != y && target->ui_mode & MASK_UI_MODE_NIGHT)
+			return x != 0;
+	}
+	if (mask & CONFIG_DENSITY && a->density != b->density)
+		return density_is_better(dtohs(a->density), dtohs(b->density),
+					 dtohs(target->density));
+	if (mask & CONFIG_TOUCHSCREEN && a->touchscreen != b->touchscreen &&
+	    target->touchscreen)
+		return a->touchscreen != 0;
+	if (mask & CONFIG_KEYBOARD_HIDDEN) {
+		x = a->input_flags & MASK_KEYSHIDDEN;
+		y = b->input_flags & MASK_KEYSHIDDEN;
+		t = target->input_flags & MASK_KEYSHIDDEN;
+		if (x != y && t) {
+			if (!x)
+				return 0;
+			if (!y)
+				return 1;
+			/* an exact match beats KEYSHIDDEN_NO matching SOFT */
+			if (x == t)
+				return 1;
+			if (y == t)
+				return 0;
+		}
+		x = a->input_flags & MASK_NAVHIDDEN;
+		y = b->input_flags & MASK_NAVHIDDEN;
+		if (x != y && target->input_flags & MASK_NAVHIDDEN)
+			return x != 0;
+	}
+	if (mask & CONFIG_KEYBOARD && a->keyboard != b->keyboard &&
+	    target->keyboard)
+		return a->keyboard != 0;
+	if (mask & CONFIG_NAVIGATION && a->navigation != b->navigation &&
+	    target->navigation)
+		return a->navigation != 0;
+	if (mask & CONFIG_SCREEN_SIZE) {
+		int da = 0, db = 0;
+
+		if (target->screen_width) {
+			da -= dtohs(a->screen_width);
+			db -= dtohs(b->screen_width);
+		}
+		if (target->screen_height) {
+			da -= dtohs(a->screen_height);
+			db -= dtohs(b->screen_height);
+		}
+		if (da != db)
+			return da < db;
+	}
+	if (mask & CONFIG_VERSION) {
+		if (a->sdk_version != b->sdk_version && target->sdk_version)
+			return dtohs(a->sdk_version) > dtohs(b->sdk_version);
+		if (a->minor_version != b->minor_version &&
+		    target->minor_version)
+			return a->minor_version != 0;
+	}
+	return 0;
 }
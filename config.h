@@ -1,10 +1,85 @@
 #ifndef ARSC_CONFIG_H
 #define ARSC_CONFIG_H
+#include <stddef.h>
+#include <stdint.h>
 
 #define CONFIG_LEN 1024
 
 struct arsc_config;
+struct config_cache;
 
-void config_to_string(const struct arsc_config *config, char buf[CONFIG_LEN]);
+/*
+ * Format config as a dash separated list of qualifiers (e.g. "fr-xhdpi"),
+ * or "-" for the default config. Return the length of the string.
+ */
+size_t config_to_string(const struct arsc_config *config, char buf[CONFIG_LEN]);
+
+/*
+ * Parse a dash separated list of qualifiers, such as
+ * "en-rUS-sw600dp-land-xhdpi-v21", into config. Qualifiers may appear in
+ * any order, and countries may be written as "US" like config_to_string
+ * prints them; "-" and "" denote the default config. Return 0 on success,
+ * or -1 if a qualifier is empty or not recognized.
+ */
+int config_from_string(const char *s, struct arsc_config *config);
+
+/*
+ * Filter selecting the configs that have all the qualifiers of a given
+ * config (e.g. "xxhdpi" selects both "xxhdpi" and "fr-xxhdpi-v4"). The
+ * comparison is done on the raw config bytes under a precomputed mask, so
+ * testing a config never formats or decodes it.
+ */
+struct config_filter {
+	struct arsc_config value;
+	struct arsc_config mask;
+};
+
+void config_filter_init(struct config_filter *filter,
+			const struct arsc_config *config);
+int config_filter_match(const struct config_filter *filter,
+			const struct arsc_config *config);
+
+/*
+ * Order configs by their raw bytes (ignoring the size field, and zero
+ * padding shorter configs), for sorting and merging. Return <0, 0 or >0
+ * like memcmp.
+ */
+int config_compare(const struct arsc_config *a, const struct arsc_config *b);
+
+/*
+ * Interning cache for config_to_string. Many types share the same config,
+ * so the cache formats each distinct config (keyed by its raw bytes) only
+ * once. The returned strings stay valid until the cache is destroyed. A
+ * cache is not thread-safe; use one per blob and thread.
+ */
+struct config_cache *config_cache_create(void);
+void config_cache_destroy(struct config_cache *cache);
+const char *config_cache_string(struct config_cache *cache,
+				const struct arsc_config *config,
+				size_t *len);
+
+/*
+ * Return a bit mask of the qualifiers set in config. Masks are computed
+ * once per type during parsing (see struct type_spec) so that the matching
+ * functions below only inspect qualifiers that can make a difference.
+ * The qualifiers past the end of an older, shorter config (see
+ * config->size) read as zero.
+ */
+uint32_t config_mask(const struct arsc_config *config);
+
+/*
+ * Return non-zero if config (with qualifier mask mask) is compatible with
+ * the target device configuration. Follows ResTable_config::match.
+ */
+int config_match(const struct arsc_config *config, uint32_t mask,
+		 const struct arsc_config *target);
+
+/*
+ * Return non-zero if a is a better match for target than b; both are
+ * assumed to match target. mask must include the qualifier masks of both a
+ * and b. Follows ResTable_config::isBetterThan.
+ */
+int config_is_better(const struct arsc_config *a, const struct arsc_config *b,
+		     uint32_t mask, const struct arsc_config *target);
 
 #endif
@@ -0,0 +1,35 @@
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+
+#include "error.h"
+
+void error_set(struct error *err, enum error_status status, size_t offset,
+	       const char *fmt, ...)
+{
+	va_list ap;
+
+	err->status = status;
+	err->offset = offset;
+	err->errnum = status == ERROR_IO ? errno : 0;
+	va_start(ap, fmt);
+	vsnprintf(err->message, sizeof(err->message), fmt, ap);
+	va_end(ap);
+}
+
+const char *error_status_string(enum error_status status)
+{
+	switch (status) {
+	case ERROR_NONE:
+		return "no error";
+	case ERROR_IO:
+		return "i/o error";
+	case ERROR_FORMAT:
+		return "malformed input";
+	case ERROR_UNSUPPORTED:
+		return "unsupported input";
+	case ERROR_NOMEM:
+		return "out of memory";
+	}
+	return "unknown error";
+}
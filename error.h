@@ -0,0 +1,30 @@
+#ifndef ARSC_ERROR_H
+#define ARSC_ERROR_H
+#include <stddef.h>
+
+/*
+ * Error reporting for functions that must not terminate the program, such
+ * as blob_try_init and map_file_try. Those functions return 0 on success
+ * and -1 on error, and fill in the struct error passed by the caller.
+ */
+enum error_status {
+	ERROR_NONE = 0,
+	ERROR_IO, /* a system call failed; errnum holds errno */
+	ERROR_FORMAT, /* malformed input */
+	ERROR_UNSUPPORTED, /* valid input this code cannot handle */
+	ERROR_NOMEM,
+};
+
+struct error {
+	enum error_status status;
+	size_t offset; /* offset in the input at which the error was found */
+	int errnum;
+	char message[256];
+};
+
+void error_set(struct error *err, enum error_status status, size_t offset,
+	       const char *fmt, ...) __attribute__((__format__(__printf__, 4, 5)));
+
+const char *error_status_string(enum error_status status);
+
+#endif
@@ -7,182 +7,283 @@
 #include <sys/types.h>
 
 #include "common.h"
+#include "error.h"
 #include "filemap.h"
+#include "zip.h"
 
-static void map_file0(const char *path, struct mapped_file *map);
+static int map_zip_entry(struct mapped_file *map, const char *entry_name,
+			 struct error *err)
+{
+	struct zip zip;
+	struct zip_buffer buf = ZIP_BUFFER_INIT;
+	const struct zip_entry *entry;
+	int ret;
+
+	if (zip_open(&zip, map->map, map->map_size, err))
+		return -1;
+	entry = zip_find(&zip, entry_name);
+	if (!entry) {
+		error_set(err, ERROR_FORMAT, 0, "no entry '%s' found",
+			  entry_name);
+		zip_close(&zip);
+		return -1;
+	}
+	ret = zip_entry_data(&zip, entry, &buf, &map->data, &map->data_size,
+			     err);
+	map->has_crc32 = 1;
+	map->crc32 = entry->crc32;
+	zip_close(&zip);
 
-#define ZIP_LFH_MAGIC 0x04034b50
-#define ZIP_CD_MAGIC 0x02014b50
-#define ZIP_EOCD_MAGIC 0x06054b50
+	/* keep the inflated data, if any, but not the inflate state */
+	map->buffer = buf.data;
+	buf.data = NULL;
+	zip_buffer_release(&buf);
+	return ret;
+}
 
 /*
- * Limited zip file parser.
- *
- * This code is only intended for retrieval of resources.arsc files in
- * apk files and so makes quite a few assumptions about the zip file
- * structure. For instance, resources.arsc is always stored rather than
- * compressed (by design for performance reasons when loaded by the
- * Android framework) and zip files only consist of a single file.
- *
- * Basic zip format grammar: [LFH file-data]* [CD]* EOCD
+ * Generic mmap wrappers. Nothing fancy, nothing unexpected.
  */
 
-/* stripped version of Local File Header */
-struct __attribute__ ((__packed__)) zip_lfh {
-	uint32_t magic;
-	uint8_t padding_1[4];
-	uint16_t compression_method;
-	uint8_t padding_2[8];
-	uint32_t compressed_size;
-	uint32_t uncompressed_size;
-	uint16_t filename_length;
-	uint16_t extra_length;
-	const char filename[0];
-};
-
-/* stripped version of Central Directory record */
-struct __attribute__ ((__packed__)) zip_cd {
-	uint32_t magic;
-	uint8_t padding_1[16];
-	uint32_t compressed_size;
-	uint32_t uncompressed_size;
-	uint16_t filename_length;
-	uint16_t extra_length;
-	uint16_t comment_length;
-	uint8_t padding_2[8];
-	uint32_t lfh_offset;
-	const char filename[0];
-};
-
-/* stripped version of End of Central Directory record */
-struct __attribute__ ((__packed__)) zip_eocd {
-	uint32_t magic;
-	uint8_t padding_1[6];
-	uint16_t entry_count; /* assume zip only spans one disk */
-	uint32_t cd_size;
-	uint32_t cd_offset;
-	uint8_t padding_2[2];
-};
-
-static const struct zip_eocd *find_eocd(const uint8_t *map, size_t size)
-{
-	const struct zip_eocd *eocd;
-
-	eocd = (struct zip_eocd *)(map + size - sizeof(*eocd));
-	die_if(dtohl(eocd->magic) != ZIP_EOCD_MAGIC,
-	       "bad zip eocd magic 0x%08x", dtohl(eocd->magic));
-	die_if(dtohs(eocd->entry_count) == 0, "bad entry count 0");
+static const struct map_options default_options = MAP_OPTIONS_INIT;
 
-	return eocd;
+static int advice(enum map_access access)
+{
+	switch (access) {
+	case MAP_ACCESS_SEQUENTIAL:
+		return MADV_SEQUENTIAL;
+	case MAP_ACCESS_RANDOM:
+		return MADV_RANDOM;
+	default:
+		return MADV_NORMAL;
+	}
 }
 
-static const struct zip_cd *find_cd_for_entry(const uint8_t *map, size_t size,
-					      const struct zip_eocd *eocd,
-					      const char *filename)
+static off_t page_floor(off_t offset)
 {
-	/*
-	 * eocd->cd_offset points to the beginning of eocd->entry_count number
-	 * of Central Directories, one per entry. Find the one representing the
-	 * requested filename.
-	 */
-	const struct zip_cd *cd;
-	size_t i;
-
-	die_if(eocd->cd_offset > size, "eocd offset too large");
-	cd = (struct zip_cd *)(map + dtohl(eocd->cd_offset));
-	for (i = 0; i < eocd->entry_count; i++) {
-		uint16_t len;
-
-		die_if(dtohl(cd->magic) != ZIP_CD_MAGIC,
-		       "bad zip cd magic 0x%08x", dtohl(cd->magic));
-
-		len = dtohs(cd->filename_length);
-		if (len == strlen(filename) &&
-		    !memcmp(cd->filename, filename, len))
-			return cd;
-		cd = (const struct zip_cd *)
-			((const uint8_t *)cd + sizeof(*cd) + len +
-			 dtohs(cd->extra_length) + dtohs(cd->comment_length));
-		die_if((const uint8_t *)cd > map + size, "cd outside map");
-	}
-	die("no entry '%s' found", filename);
-	return NULL;
+	return offset & ~(off_t)(sysconf(_SC_PAGESIZE) - 1);
 }
 
-static const struct zip_lfh *find_lfh_for_entry(const uint8_t *map, size_t size,
-						const struct zip_cd *cd)
+/*
+ * mmap length bytes of fd at offset into map->mapping. mmap needs a page
+ * aligned offset, so the mapping may start before offset; return the
+ * address of offset.
+ */
+static const void *mmap_range(int fd, off_t offset, size_t length,
+			      int populate, struct mapped_file *map)
 {
-	const struct zip_lfh *lfh;
+	off_t start = page_floor(offset);
+	int flags = MAP_PRIVATE | (populate ? MAP_POPULATE : 0);
+	void *p;
 
-	die_if(cd->lfh_offset > size, "lfh offset outside map");
-	lfh = (const struct zip_lfh *)(map + cd->lfh_offset);
+	p = mmap(NULL, length + (offset - start), PROT_READ, flags, fd, start);
+	if (p == MAP_FAILED)
+		return NULL;
+	map->mapping = p;
+	map->mapping_size = length + (offset - start);
+	map->mapping_offset = start;
+	return (const uint8_t *)p + (offset - start);
+}
+
+/*
+ * Map length bytes of fd at offset, or the rest of the file if length is
+ * 0. Apks are not prefaulted, and only their directory records are read
+ * from this mapping, so it is marked for random access: readahead would
+ * pull in data that is never used.
+ */
+static int map_fd0(int fd, const char *name, off_t offset, size_t length,
+		   const struct map_options *opts, struct mapped_file *map,
+		   struct error *err)
+{
+	uint32_t magic = 0;
+	struct stat st;
+	int is_zip;
 
-	die_if(dtohs(lfh->compression_method) != 0,
-	       "unhandled compression method %d",
-	       dtohs(lfh->compression_method));
+	if (fstat(fd, &st) < 0) {
+		error_set(err, ERROR_IO, 0, "stat %s", name);
+		return -1;
+	}
+	if (offset < 0 || offset > st.st_size ||
+	    length > (uint64_t)(st.st_size - offset)) {
+		error_set(err, ERROR_FORMAT, 0,
+			  "%s: range %jd+%zd outside file of size %jd",
+			  name, (intmax_t)offset, length,
+			  (intmax_t)st.st_size);
+		return -1;
+	}
+	if (length == 0)
+		length = st.st_size - offset;
+	if (length == 0) {
+		error_set(err, ERROR_FORMAT, 0, "%s: empty file", name);
+		return -1;
+	}
+	if (length >= sizeof(magic) &&
+	    pread(fd, &magic, sizeof(magic), offset) != sizeof(magic)) {
+		error_set(err, ERROR_IO, 0, "read %s", name);
+		return -1;
+	}
+	is_zip = zip_is_zip(&magic, length);
 
-	return lfh;
+	map->map = mmap_range(fd, offset, length,
+			      opts->populate && !is_zip, map);
+	if (!map->map) {
+		error_set(err, ERROR_IO, 0, "mmap %s", name);
+		return -1;
+	}
+	map->map_size = length;
+	map->fd = fd;
+	if (is_zip && !opts->whole_file)
+		madvise((void *)map->mapping, map->mapping_size, MADV_RANDOM);
+	return 0;
 }
 
-static void adjust_map_to_zip_entry(struct mapped_file *map,
-				    const char *entry_name)
+/*
+ * Replace the mapping of the whole apk by one of the resources.arsc entry
+ * only, or by none at all if the entry was inflated into map->buffer.
+ */
+static int map_entry_only(struct mapped_file *map,
+			  const struct map_options *opts, struct error *err)
 {
-	const struct zip_eocd *eocd;
-	const struct zip_cd *cd;
-	const struct zip_lfh *lfh;
-	uint32_t entry_size;
-	uint32_t entry_offset;
-
-	eocd = find_eocd(map->map, map->map_size);
-	cd = find_cd_for_entry(map->map, map->map_size, eocd, entry_name);
-	lfh = find_lfh_for_entry(map->map, map->map_size, cd);
-	entry_size = lfh->compressed_size;
-	entry_offset = (const uint8_t *)lfh - (const uint8_t *)map->map +
-		sizeof(*lfh) + dtohs(lfh->filename_length) +
-		dtohs(lfh->extra_length);
-
-	map->data = (const uint8_t *)map->map + entry_offset;
-	map->data_size = entry_size;
+	const void *old = map->mapping;
+	size_t old_size = map->mapping_size;
+	off_t offset;
+
+	if (map->buffer) {
+		map->mapping = NULL;
+		map->mapping_size = 0;
+	} else {
+		offset = map->mapping_offset +
+			((const uint8_t *)map->data -
+			 (const uint8_t *)map->mapping);
+		map->data = mmap_range(map->fd, offset, map->data_size,
+				       opts->populate, map);
+		if (!map->data) {
+			/* keep the old mapping, so unmap_file releases it */
+			map->mapping = old;
+			map->mapping_size = old_size;
+			error_set(err, ERROR_IO, 0, "mmap resources.arsc");
+			return -1;
+		}
+	}
+	munmap((void *)old, old_size);
+	map->map = map->data;
+	map->map_size = map->data_size;
+	return 0;
 }
 
 /*
- * Generic mmap wrappers. Nothing fancy, nothing unexpected.
+ * Point map->data at the resources.arsc blob: the whole map, or, if the
+ * map is an apk, the resources.arsc entry within the zip (or an inflated
+ * copy of it).
  */
+static int map_data(struct mapped_file *map, const struct map_options *opts,
+		    struct error *err)
+{
+	map->data = map->map;
+	map->data_size = map->map_size;
+	map->buffer = NULL;
+	map->has_crc32 = 0;
+	if (zip_is_zip(map->data, map->data_size)) {
+		if (map_zip_entry(map, "resources.arsc", err) ||
+		    (map->mapping && !opts->whole_file &&
+		     map_entry_only(map, opts, err))) {
+			unmap_file(map);
+			return -1;
+		}
+	}
+	map_advise(map, opts->access);
+	return 0;
+}
 
-static void map_file0(const char *path, struct mapped_file *map)
+int map_file_try_opts(const char *path, const struct map_options *opts,
+		      struct mapped_file *map, struct error *err)
 {
-	struct stat st;
+	int fd = open(path, O_RDONLY);
 
-	if (stat(path, &st) < 0)
-		die("stat");
-	map->fd = open(path, O_RDONLY);
-	if (map->fd < 0)
-		die("open");
-	map->map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, map->fd, 0);
-	if (map->map == MAP_FAILED)
-		die("mmap");
-	map->map_size = st.st_size;
+	if (fd < 0) {
+		error_set(err, ERROR_IO, 0, "open %s", path);
+		return -1;
+	}
+	if (map_fd0(fd, path, 0, 0, opts, map, err)) {
+		close(fd);
+		return -1;
+	}
+	return map_data(map, opts, err);
+}
 
-	map->data = map->map;
-	map->data_size = map->map_size;
+int map_file_try(const char *path, struct mapped_file *map,
+		 struct error *err)
+{
+	return map_file_try_opts(path, &default_options, map, err);
 }
 
-void map_file(const char *path, struct mapped_file *map)
+int map_fd_range_try(int fd, off_t offset, size_t length,
+		     const struct map_options *opts,
+		     struct mapped_file *map, struct error *err)
 {
-	uint32_t magic;
-
-	map_file0(path, map);
-	magic = *(const uint32_t *)map->data;
-	if (map->data_size > sizeof(uint32_t) &&
-	    dtohl(magic) == ZIP_LFH_MAGIC) {
-		/* file is likely an apk, modify map->data to point to the
-		 * resources.arsc entry withinh the zip */
-		adjust_map_to_zip_entry(map, "resources.arsc");
+	int dup_fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+
+	if (!opts)
+		opts = &default_options;
+	if (dup_fd < 0) {
+		error_set(err, ERROR_IO, 0, "dup fd %d", fd);
+		return -1;
 	}
+	if (map_fd0(dup_fd, "fd", offset, length, opts, map, err)) {
+		close(dup_fd);
+		return -1;
+	}
+	return map_data(map, opts, err);
+}
+
+int map_fd_try(int fd, struct mapped_file *map, struct error *err)
+{
+	return map_fd_range_try(fd, 0, 0, &default_options, map, err);
+}
+
+int map_buffer_try(const void *data, size_t size, struct mapped_file *map,
+		   struct error *err)
+{
+	if (size == 0) {
+		error_set(err, ERROR_FORMAT, 0, "empty buffer");
+		return -1;
+	}
+	map->mapping = NULL;
+	map->mapping_size = 0;
+	map->map = data;
+	map->map_size = size;
+	map->fd = -1;
+	return map_data(map, &default_options, err);
+}
+
+void map_file(const char *path, struct mapped_file *map)
+{
+	struct error err;
+
+	if (map_file_try(path, map, &err))
+		die("%s", err.message);
+}
+
+void map_advise(const struct mapped_file *map, enum map_access access)
+{
+	const uint8_t *data = map->data, *start;
+
+	/* nothing to advise for buffers, or data inflated into one */
+	if (!map->mapping || data < (const uint8_t *)map->mapping ||
+	    data >= (const uint8_t *)map->mapping + map->mapping_size)
+		return;
+	start = (const uint8_t *)map->mapping +
+		page_floor(data - (const uint8_t *)map->mapping);
+	madvise((void *)start, data + map->data_size - start,
+		advice(access));
 }
 
 void unmap_file(const struct mapped_file *map)
 {
-	munmap((void *)map->map, map->map_size);
-	close(map->fd);
+	free(map->buffer);
+	/* buffers passed to map_buffer_try belong to the caller */
+	if (map->mapping)
+		munmap((void *)map->mapping, map->mapping_size);
+	if (map->fd >= 0)
+		close(map->fd);
 }
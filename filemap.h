@@ -1,5 +1,10 @@
 #ifndef ARSC_FILEMAP_H
 #define ARSC_FILEMAP_H
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+struct error;
 
 /*
  * Struct representing a mmap'ed file.
@@ -8,21 +13,91 @@
  * fields are used for internal book-keeping. (For plain resources.arsc
  * files, map and data are the same. For zip files, map represents the
  * entire zip file and data the resources.arsc file stored within the
- * zip.)
+ * zip, or, if the entry is compressed, the inflated copy in buffer. map
+ * lies within mapping, the region to munmap, which starts at a page
+ * boundary; buffers passed to map_buffer_try have no mapping and no fd.
+ * Unless map_options.whole_file is set, only the resources.arsc entry of
+ * an apk stays mapped, and map is the same as data.)
  */
 struct mapped_file {
 	const void *map;
 	size_t map_size;
+	const void *mapping;
+	size_t mapping_size;
+	off_t mapping_offset; /* file offset of mapping */
 	int fd;
+	void *buffer;
 
 	const void *data;
 	size_t data_size;
+
+	/* the zip directory's CRC-32 of data, if data came from a zip */
+	int has_crc32;
+	uint32_t crc32;
 };
 
+/*
+ * How the resources.arsc data will be accessed, passed on to madvise:
+ * sequentially by full parses and dumps, randomly by point lookups in a
+ * blob set up from an index.
+ */
+enum map_access {
+	MAP_ACCESS_NORMAL,
+	MAP_ACCESS_SEQUENTIAL,
+	MAP_ACCESS_RANDOM,
+};
+
+struct map_options {
+	enum map_access access;
+	int populate; /* prefault the data with MAP_POPULATE */
+	int whole_file; /* keep all of an apk mapped, not just the entry */
+};
+
+#define MAP_OPTIONS_INIT { MAP_ACCESS_NORMAL, 0, 0 }
+
 /*
  * Memory map a file. Accepts both plain resources.arsc files and apk files.
  */
 void map_file(const char *path, struct mapped_file *map);
+
+/*
+ * Like map_file, but return -1 and fill in err instead of terminating the
+ * program on errors. Nothing needs to be unmapped after a failure.
+ */
+int map_file_try(const char *path, struct mapped_file *map,
+		 struct error *err);
+int map_file_try_opts(const char *path, const struct map_options *opts,
+		      struct mapped_file *map, struct error *err);
+
+/*
+ * Like map_file_try, but map the file open as fd. fd is duplicated, so
+ * the caller may close it once this returns.
+ */
+int map_fd_try(int fd, struct mapped_file *map, struct error *err);
+
+/*
+ * Like map_fd_try, but map only length bytes at offset, e.g. an apk
+ * stored within a larger container. A length of 0 means the rest of the
+ * file. offset need not be page aligned. opts may be NULL.
+ */
+int map_fd_range_try(int fd, off_t offset, size_t length,
+		     const struct map_options *opts,
+		     struct mapped_file *map, struct error *err);
+
+/*
+ * Like map_file_try, but use size bytes at data instead of a file. Nothing
+ * is copied unless the resources.arsc entry is compressed, so data must
+ * outlive map.
+ */
+int map_buffer_try(const void *data, size_t size, struct mapped_file *map,
+		   struct error *err);
+
+/*
+ * Change the access hint for the data of map, e.g. once a blob has been
+ * parsed and only lookups remain.
+ */
+void map_advise(const struct mapped_file *map, enum map_access access);
+
 void unmap_file(const struct mapped_file *map);
 
 #endif
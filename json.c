@@ -0,0 +1,158 @@
+#include <string.h>
+
+#include "common.h"
+#include "json.h"
+
+void json_init(struct json_writer *w, FILE *out)
+{
+	w->out = out;
+	w->len = 0;
+	w->depth = 0;
+	w->need_comma[0] = 0;
+}
+
+void json_flush(struct json_writer *w)
+{
+	if (w->len > 0 && fwrite(w->buf, 1, w->len, w->out) != w->len)
+		die("fwrite");
+	w->len = 0;
+}
+
+static inline void reserve(struct json_writer *w, size_t n)
+{
+	if (w->len + n > sizeof(w->buf))
+		json_flush(w);
+}
+
+static inline void put_char(struct json_writer *w, char c)
+{
+	reserve(w, 1);
+	w->buf[w->len++] = c;
+}
+
+static void put_raw(struct json_writer *w, const char *s, size_t len)
+{
+	if (len > sizeof(w->buf)) {
+		json_flush(w);
+		if (fwrite(s, 1, len, w->out) != len)
+			die("fwrite");
+		return;
+	}
+	reserve(w, len);
+	memcpy(w->buf + w->len, s, len);
+	w->len += len;
+}
+
+static void put_string(struct json_writer *w, const char *s, size_t len)
+{
+	static const char hex[] = "0123456789abcdef";
+	size_t i, start = 0;
+
+	put_char(w, '"');
+	for (i = 0; i < len; i++) {
+		unsigned char c = s[i];
+		char esc[6];
+
+		if (c >= 0x20 && c != '"' && c != '\\')
+			continue;
+		put_raw(w, s + start, i - start);
+		start = i + 1;
+		esc[0] = '\\';
+		switch (c) {
+		case '"':
+		case '\\':
+			esc[1] = c;
+			put_raw(w, esc, 2);
+			break;
+		case '\n':
+			put_raw(w, "\\n", 2);
+			break;
+		case '\t':
+			put_raw(w, "\\t", 2);
+			break;
+		default:
+			esc[1] = 'u';
+			esc[2] = '0';
+			esc[3] = '0';
+			esc[4] = hex[c >> 4];
+			esc[5] = hex[c & 0xf];
+			put_raw(w, esc, 6);
+			break;
+		}
+	}
+	put_raw(w, s + start, len - start);
+	put_char(w, '"');
+}
+
+/* emit the separator and key (if any) that precede a value */
+static void begin_value(struct json_writer *w, const char *key)
+{
+	if (w->need_comma[w->depth])
+		put_char(w, ',');
+	w->need_comma[w->depth] = 1;
+	if (key) {
+		put_string(w, key, strlen(key));
+		put_char(w, ':');
+	}
+}
+
+static void push(struct json_writer *w, const char *key, char c)
+{
+	begin_value(w, key);
+	put_char(w, c);
+	die_if(++w->depth >= JSON_MAX_DEPTH, "json nesting too deep");
+	w->need_comma[w->depth] = 0;
+}
+
+static void pop(struct json_writer *w, char c)
+{
+	die_if(w->depth == 0, "unbalanced json");
+	w->depth--;
+	put_char(w, c);
+}
+
+void json_begin_object(struct json_writer *w, const char *key)
+{
+	push(w, key, '{');
+}
+
+void json_end_object(struct json_writer *w)
+{
+	pop(w, '}');
+}
+
+void json_begin_array(struct json_writer *w, const char *key)
+{
+	push(w, key, '[');
+}
+
+void json_end_array(struct json_writer *w)
+{
+	pop(w, ']');
+}
+
+void json_string(struct json_writer *w, const char *key, const char *s,
+		 size_t len)
+{
+	begin_value(w, key);
+	put_string(w, s, len);
+}
+
+void json_uint(struct json_writer *w, const char *key, uint64_t value)
+{
+	char tmp[20];
+	size_t n = sizeof(tmp);
+
+	begin_value(w, key);
+	do {
+		tmp[--n] = '0' + value % 10;
+		value /= 10;
+	} while (value);
+	put_raw(w, tmp + n, sizeof(tmp) - n);
+}
+
+void json_newline(struct json_writer *w)
+{
+	put_char(w, '\n');
+	w->need_comma[w->depth] = 0;
+}
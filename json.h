@@ -0,0 +1,43 @@
+#ifndef ARSC_JSON_H
+#define ARSC_JSON_H
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Streaming JSON writer. Values are formatted straight into a fixed size
+ * buffer, which is written to out whenever it fills up; nothing is kept
+ * once written, so output of any size is produced in constant memory.
+ *
+ * Members of objects take a key; array elements and top-level values pass
+ * NULL. Commas are inserted automatically.
+ */
+#define JSON_BUFFER_SIZE (64 * 1024)
+#define JSON_MAX_DEPTH 32
+
+struct json_writer {
+	FILE *out;
+	size_t len;
+	unsigned int depth;
+	int need_comma[JSON_MAX_DEPTH];
+	char buf[JSON_BUFFER_SIZE];
+};
+
+void json_init(struct json_writer *w, FILE *out);
+void json_flush(struct json_writer *w);
+
+void json_begin_object(struct json_writer *w, const char *key);
+void json_end_object(struct json_writer *w);
+void json_begin_array(struct json_writer *w, const char *key);
+void json_end_array(struct json_writer *w);
+
+void json_string(struct json_writer *w, const char *key, const char *s,
+		 size_t len);
+void json_uint(struct json_writer *w, const char *key, uint64_t value);
+
+/*
+ * End the current top-level value with a newline (used for ndjson).
+ */
+void json_newline(struct json_writer *w);
+
+#endif
@@ -0,0 +1,369 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "arsc.h"
+#include "blob.h"
+#include "common.h"
+#include "config.h"
+#include "error.h"
+#include "filemap.h"
+#include "libarsc.h"
+#include "names.h"
+#include "resource.h"
+#include "strpool.h"
+
+/*
+ * Implementation of the public API in libarsc.h: thin wrappers that keep
+ * the internal structs out of the public header.
+ */
+struct arsc_file {
+	unsigned long refs; /* updated with __atomic builtins */
+	struct mapped_file map;
+	struct blob *blob;
+	struct names *names;
+};
+
+/*
+ * The lock only covers reading or replacing file and taking a reference:
+ * files are opened before, and closed after, the lock is held.
+ */
+struct arsc_slot {
+	pthread_mutex_t lock;
+	struct arsc_file *file;
+};
+
+_Static_assert((int)ARSC_ERROR_NOMEM == (int)ERROR_NOMEM,
+	       "struct arsc_error status values must match struct error");
+
+static void export_error(struct arsc_error *out, const struct error *err)
+{
+	out->status = (enum arsc_error_status)err->status;
+	out->offset = err->offset;
+	out->errnum = err->errnum;
+	memcpy(out->message, err->message, sizeof(out->message));
+}
+
+/*
+ * Files are mapped for the sequential read of the full parse, after which
+ * only lookups remain.
+ */
+static const struct map_options map_options = {
+	.access = MAP_ACCESS_SEQUENTIAL,
+};
+
+/*
+ * Parse file->map, which is unmapped on errors. The blob is parsed in
+ * full, not lazily, so that lookups never modify it.
+ */
+static int open_map(struct arsc_file **file_pp, struct arsc_file *file,
+		    struct error *err)
+{
+	if (blob_try_init(&file->blob, file->map.data, file->map.data_size,
+			  err)) {
+		unmap_file(&file->map);
+		return -1;
+	}
+	map_advise(&file->map, MAP_ACCESS_RANDOM);
+	file->names = names_create(file->blob, err);
+	if (!file->names) {
+		blob_destroy(file->blob);
+		unmap_file(&file->map);
+		return -1;
+	}
+	file->refs = 1;
+	*file_pp = file;
+	return 0;
+}
+
+static struct arsc_file *alloc_file(struct arsc_error *err)
+{
+	struct arsc_file *file = malloc(sizeof(*file));
+	struct error e;
+
+	if (!file) {
+		error_set(&e, ERROR_NOMEM, 0, "out of memory");
+		export_error(err, &e);
+	}
+	return file;
+}
+
+int arsc_open(struct arsc_file **file_pp, const char *path,
+	      struct arsc_error *err)
+{
+	struct arsc_file *file = alloc_file(err);
+	struct error e;
+
+	if (!file)
+		return -1;
+	if (map_file_try_opts(path, &map_options, &file->map, &e) ||
+	    open_map(file_pp, file, &e)) {
+		export_error(err, &e);
+		free(file);
+		return -1;
+	}
+	return 0;
+}
+
+int arsc_open_fd(struct arsc_file **file_pp, int fd, struct arsc_error *err)
+{
+	return arsc_open_fd_range(file_pp, fd, 0, 0, err);
+}
+
+int arsc_open_fd_range(struct arsc_file **file_pp, int fd, off_t offset,
+		       size_t length, struct arsc_error *err)
+{
+	struct arsc_file *file = alloc_file(err);
+	struct error e;
+
+	if (!file)
+		return -1;
+	if (map_fd_range_try(fd, offset, length, &map_options, &file->map,
+			     &e) ||
+	    open_map(file_pp, file, &e)) {
+		export_error(err, &e);
+		free(file);
+		return -1;
+	}
+	return 0;
+}
+
+int arsc_open_buffer(struct arsc_file **file_pp, const void *data,
+		     size_t size, struct arsc_error *err)
+{
+	struct arsc_file *file = alloc_file(err);
+	struct error e;
+
+	if (!file)
+		return -1;
+	if (map_buffer_try(data, size, &file->map, &e) ||
+	    open_map(file_pp, file, &e)) {
+		export_error(err, &e);
+		free(file);
+		return -1;
+	}
+	return 0;
+}
+
+struct arsc_file *arsc_ref(struct arsc_file *file)
+{
+	__atomic_add_fetch(&file->refs, 1, __ATOMIC_RELAXED);
+	return file;
+}
+
+void arsc_close(struct arsc_file *file)
+{
+	/* the release orders this thread's reads of file before the free */
+	if (!file || __atomic_sub_fetch(&file->refs, 1, __ATOMIC_ACQ_REL))
+		return;
+	names_destroy(file->names);
+	blob_destroy(file->blob);
+	unmap_file(&file->map);
+	free(file);
+}
+
+struct arsc_slot *arsc_slot_create(struct arsc_file *file)
+{
+	struct arsc_slot *slot = malloc(sizeof(*slot));
+
+	if (!slot)
+		return NULL;
+	pthread_mutex_init(&slot->lock, NULL);
+	slot->file = file ? arsc_ref(file) : NULL;
+	return slot;
+}
+
+void arsc_slot_destroy(struct arsc_slot *slot)
+{
+	if (!slot)
+		return;
+	arsc_close(slot->file);
+	pthread_mutex_destroy(&slot->lock);
+	free(slot);
+}
+
+struct arsc_file *arsc_slot_get(struct arsc_slot *slot)
+{
+	struct arsc_file *file;
+
+	pthread_mutex_lock(&slot->lock);
+	file = slot->file ? arsc_ref(slot->file) : NULL;
+	pthread_mutex_unlock(&slot->lock);
+	return file;
+}
+
+void arsc_slot_set(struct arsc_slot *slot, struct arsc_file *file)
+{
+	struct arsc_file *old;
+
+	if (file)
+		arsc_ref(file);
+	pthread_mutex_lock(&slot->lock);
+	old = slot->file;
+	slot->file = file;
+	pthread_mutex_unlock(&slot->lock);
+	arsc_close(old);
+}
+
+/*
+ * entry comes from resource_type_entry, which only returns entries whose
+ * value, or maps, lie within type; the value can be read unchecked.
+ */
+static void fill_resource(struct arsc_resource *res, uint32_t id,
+			  const struct arsc_type *type,
+			  const struct arsc_entry *entry)
+{
+	res->id = id;
+	res->flags = dtohs(entry->flags);
+	if (res->flags & ARSC_ENTRY_FLAG_COMPLEX) {
+		res->data_type = 0;
+		res->data = 0;
+	} else {
+		const struct arsc_value *value = (const struct arsc_value *)
+			((const uint8_t *)entry + dtohs(entry->size));
+
+		res->data_type = value->data_type;
+		res->data = dtohl(value->data);
+	}
+	res->private_type = type;
+	res->private_entry = entry;
+}
+
+uint32_t arsc_find(const struct arsc_file *file, const char *name)
+{
+	return names_lookup(file->names, name);
+}
+
+int arsc_resolve(const struct arsc_file *file, uint32_t id,
+		 const char *config, struct arsc_resource *res)
+{
+	struct arsc_config target;
+	struct resource_entry e;
+
+	if (config_from_string(config ? config : "", &target))
+		return -1;
+	if (resource_resolve(file->blob, id, &target, &e))
+		return -1;
+	fill_resource(res, id, e.type, e.entry);
+	return 0;
+}
+
+int arsc_foreach(const struct arsc_file *file, arsc_resource_fn fn,
+		 void *data)
+{
+	const struct blob *blob = file->blob;
+	struct arsc_resource res;
+	uint32_t i, index;
+	size_t k, t;
+	int ret;
+
+	for (i = 0; i < dtohl(blob->header->data.package_count); i++) {
+		const struct package *pkg = &blob->packages[i];
+		uint8_t package_id = dtohl(pkg->package->data.id);
+
+		for (k = 0; k < pkg->spec_count; k++) {
+			const struct type_spec *spec = &pkg->specs[k];
+			uint32_t count = dtohl(spec->spec->data.entry_count);
+
+			for (index = 0; index < count && index <= 0xffff;
+			     index++) {
+				uint32_t id = RESOURCE_ID(package_id,
+							  spec->spec->data.id,
+							  index);
+
+				for (t = 0; t < spec->type_count; t++) {
+					const struct arsc_entry *entry;
+
+					entry = resource_type_entry(
+						spec->types[t], index);
+					if (!entry)
+						continue;
+					fill_resource(&res, id, spec->types[t],
+						      entry);
+					ret = fn(&res, data);
+					if (ret)
+						return ret;
+				}
+			}
+		}
+	}
+	return 0;
+}
+
+/*
+ * Append str to the snprintf style output buf of size bytes, of which n
+ * have been produced so far. Return the new n.
+ */
+static size_t append(char *buf, size_t size, size_t n,
+		     const struct pool_string *str)
+{
+	if (n >= size)
+		return n + strpool_to_utf8(str, NULL, 0);
+	return n + strpool_to_utf8(str, buf + n, size - n);
+}
+
+ssize_t arsc_resource_config(const struct arsc_resource *res, char *buf,
+			     size_t size)
+{
+	const struct arsc_type *type = res->private_type;
+	char tmp[CONFIG_LEN];
+	struct pool_string str = { tmp, 0, 1 };
+
+	str.len = config_to_string(&type->data.config, tmp);
+	return strpool_to_utf8(&str, buf, size);
+}
+
+static const struct package *find_package(const struct blob *blob,
+					  uint8_t id)
+{
+	uint32_t i;
+
+	for (i = 0; i < dtohl(blob->header->data.package_count); i++)
+		if (dtohl(blob->packages[i].package->data.id) == id)
+			return &blob->packages[i];
+	return NULL;
+}
+
+ssize_t arsc_resource_name(const struct arsc_file *file,
+			   const struct arsc_resource *res,
+			   char *buf, size_t size)
+{
+	const struct arsc_entry *entry = res->private_entry;
+	const struct package *pkg;
+	struct pool_string str;
+	const uint16_t *name;
+	size_t n = 0, max;
+
+	pkg = find_package(file->blob, RESOURCE_PACKAGE_ID(res->id));
+	if (!pkg)
+		return -1;
+
+	name = pkg->package->data.name;
+	max = sizeof(pkg->package->data.name) / sizeof(uint16_t);
+	str = (struct pool_string){ name, 0, 0 };
+	while (str.len < max && name[str.len])
+		str.len++;
+	n = append(buf, size, n, &str);
+	n = append(buf, size, n, &(struct pool_string){ ":", 1, 1 });
+
+	if (resource_type_name(pkg, RESOURCE_TYPE_ID(res->id), &str))
+		return -1;
+	n = append(buf, size, n, &str);
+	n = append(buf, size, n, &(struct pool_string){ "/", 1, 1 });
+
+	if (strpool_get(pkg->sp_resource_names, dtohl(entry->key), &str))
+		return -1;
+	return append(buf, size, n, &str);
+}
+
+ssize_t arsc_resource_string(const struct arsc_file *file,
+			     const struct arsc_resource *res,
+			     char *buf, size_t size)
+{
+	struct pool_string str;
+
+	if (res->data_type != ARSC_DATA_TYPE_STRING ||
+	    strpool_get(file->blob->sp_values, res->data, &str))
+		return -1;
+	return strpool_to_utf8(&str, buf, size);
+}
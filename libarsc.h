@@ -0,0 +1,156 @@
+#ifndef LIBARSC_H
+#define LIBARSC_H
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * Public API of libarsc.so. Everything else in this tree is internal.
+ *
+ * A struct arsc_file is a parsed resources.arsc blob, opened from a path,
+ * an fd or a memory buffer holding either a resources.arsc file or an apk.
+ * Opening parses the blob and builds its name index up front; afterwards
+ * the handle is never modified, so any number of threads may call the
+ * functions taking a const struct arsc_file * concurrently.
+ *
+ * Handles are reference counted: a thread that needs a handle to stay
+ * open takes a reference with arsc_ref and drops it with arsc_close. The
+ * file is unmapped when the last reference is dropped. A struct arsc_slot
+ * holds the current version of a file, which can be replaced while other
+ * threads keep using the previous one.
+ *
+ * Resource ids have the form 0xPPTTEEEE (package, type, entry). Configs
+ * are qualifier strings such as "en-rUS-xhdpi-v21"; "-" or "" denote the
+ * default config.
+ */
+#define ARSC_API __attribute__((__visibility__("default")))
+
+struct arsc_file;
+struct arsc_slot;
+
+enum arsc_error_status {
+	ARSC_ERROR_NONE = 0,
+	ARSC_ERROR_IO, /* a system call failed; errnum holds errno */
+	ARSC_ERROR_FORMAT, /* malformed input */
+	ARSC_ERROR_UNSUPPORTED, /* valid input libarsc cannot handle */
+	ARSC_ERROR_NOMEM,
+};
+
+struct arsc_error {
+	enum arsc_error_status status;
+	size_t offset; /* offset in the input at which the error was found */
+	int errnum;
+	char message[256];
+};
+
+/*
+ * Open a resources.arsc or apk file. Return 0 on success, or -1 and fill
+ * in err. The new handle holds one reference. arsc_open_fd duplicates fd,
+ * so the caller may close it once this returns. arsc_open_fd_range opens
+ * the length bytes at offset within fd, or the rest of the file if length
+ * is 0. arsc_open_buffer does not copy data (unless the resources.arsc
+ * entry is compressed), so data must outlive the handle. The library is
+ * built with _FILE_OFFSET_BITS=64; on 32 bit systems, callers of
+ * arsc_open_fd_range must be too, so that off_t agrees.
+ */
+ARSC_API int arsc_open(struct arsc_file **file, const char *path,
+		       struct arsc_error *err);
+ARSC_API int arsc_open_fd(struct arsc_file **file, int fd,
+			  struct arsc_error *err);
+ARSC_API int arsc_open_fd_range(struct arsc_file **file, int fd,
+				off_t offset, size_t length,
+				struct arsc_error *err);
+ARSC_API int arsc_open_buffer(struct arsc_file **file, const void *data,
+			      size_t size, struct arsc_error *err);
+
+/*
+ * Take another reference to file, and return file. arsc_close drops a
+ * reference, and closes the file when it was the last one.
+ */
+ARSC_API struct arsc_file *arsc_ref(struct arsc_file *file);
+ARSC_API void arsc_close(struct arsc_file *file);
+
+/*
+ * A slot holding the current version of a file, or NULL. arsc_slot_get
+ * returns a new reference to the current file, which stays valid however
+ * often the slot is updated until the caller drops it with arsc_close.
+ * arsc_slot_set makes the slot take a reference to file (which may be
+ * NULL) and drops the slot's reference to the previous file. All of them
+ * may be called concurrently; readers are never held up by the opening or
+ * closing of files.
+ */
+ARSC_API struct arsc_slot *arsc_slot_create(struct arsc_file *file);
+ARSC_API void arsc_slot_destroy(struct arsc_slot *slot);
+ARSC_API struct arsc_file *arsc_slot_get(struct arsc_slot *slot);
+ARSC_API void arsc_slot_set(struct arsc_slot *slot, struct arsc_file *file);
+
+/*
+ * One configuration of a resource. data_type and data are the Res_value
+ * fields; both are 0 for complex (map) resources, which have
+ * ARSC_RESOURCE_COMPLEX set in flags. The private fields point into the
+ * blob and are only valid while the file is open.
+ */
+struct arsc_resource {
+	uint32_t id;
+	uint16_t flags;
+	uint8_t data_type;
+	uint32_t data;
+
+	const void *private_type;
+	const void *private_entry;
+};
+
+enum {
+	ARSC_RESOURCE_COMPLEX = 0x0001,
+	ARSC_RESOURCE_PUBLIC = 0x0002,
+	ARSC_RESOURCE_WEAK = 0x0004,
+};
+
+#define ARSC_DATA_TYPE_STRING 0x03
+
+/*
+ * Find the id of a resource by name, on the form "[package:]type/name".
+ * Return 0 if there is no such resource.
+ */
+ARSC_API uint32_t arsc_find(const struct arsc_file *file, const char *name);
+
+/*
+ * Resolve resource id for the device config config: store the best
+ * matching configuration of the resource in res. Return 0 on success, or
+ * -1 if no configuration matches or config cannot be parsed.
+ */
+ARSC_API int arsc_resolve(const struct arsc_file *file, uint32_t id,
+			  const char *config, struct arsc_resource *res);
+
+/*
+ * Call fn for every configuration of every resource, in resource id
+ * order. Iteration stops when fn returns non-zero; return that value, or
+ * 0 if fn always returned 0.
+ */
+typedef int (*arsc_resource_fn)(const struct arsc_resource *res,
+				void *data);
+
+ARSC_API int arsc_foreach(const struct arsc_file *file, arsc_resource_fn fn,
+			  void *data);
+
+/*
+ * The functions below write NUL terminated UTF-8 strings and behave like
+ * snprintf: at most size bytes are written, and the return value is the
+ * length of the full string, or -1 if there is no such string.
+ */
+
+/* the qualifier string of the config of res, e.g. "fr-hdpi" */
+ARSC_API ssize_t arsc_resource_config(const struct arsc_resource *res,
+				      char *buf, size_t size);
+
+/* the name of res, on the form "package:type/name" */
+ARSC_API ssize_t arsc_resource_name(const struct arsc_file *file,
+				    const struct arsc_resource *res,
+				    char *buf, size_t size);
+
+/* the value of res, if its data_type is ARSC_DATA_TYPE_STRING */
+ARSC_API ssize_t arsc_resource_string(const struct arsc_file *file,
+				      const struct arsc_resource *res,
+				      char *buf, size_t size);
+
+#endif
@@ -0,0 +1,535 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "arsc.h"
+#include "blob.h"
+#include "common.h"
+#include "error.h"
+#include "names.h"
+#include "resource.h"
+#include "strpool.h"
+
+/*
+ * Open addressing hash tables with linear probing. Capacities are powers
+ * of two, at least twice the number of keys.
+ *
+ * Each package has two string tables, mapping type names and resource
+ * names to their string pool indices. One shared id table then maps
+ * (package id, type id, key index) to the resource id. The package and
+ * type ids are part of the resource id, so a slot only needs to store the
+ * key index next to it.
+ */
+struct string_slot {
+	uint32_t hash;
+	uint32_t index; /* string pool index + 1; 0 means empty */
+};
+
+struct string_table {
+	const struct arsc_string_pool *pool;
+	struct string_slot *slots;
+	uint32_t mask;
+};
+
+struct id_slot {
+	uint32_t key; /* key string index + 1; 0 means empty */
+	uint32_t id;
+};
+
+struct names_package {
+	const struct arsc_package *package;
+	uint8_t id;
+	uint32_t type_id_offset;
+	struct string_table types;
+	struct string_table keys;
+};
+
+struct names {
+	struct names_package *packages;
+	size_t package_count;
+	struct id_slot *ids;
+	uint32_t id_mask;
+	int loaded; /* slots point into a names_load buffer */
+};
+
+static uint32_t hash_bytes(const char *s, size_t len)
+{
+	uint32_t h = 2166136261u;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		h ^= (uint8_t)s[i];
+		h *= 16777619u;
+	}
+	return h;
+}
+
+static uint32_t hash_id(uint32_t type, uint32_t key)
+{
+	uint32_t h = (type * 0x9e3779b1u) ^ (key * 0x85ebca6bu);
+	return h ^ (h >> 15);
+}
+
+static uint32_t table_capacity(size_t count)
+{
+	uint32_t n = 16;
+
+	while (n < 2 * count)
+		n *= 2;
+	return n;
+}
+
+/* Return -1 if out of memory; table->slots is then NULL or owned */
+static int string_table_init(struct string_table *table,
+			     const struct arsc_string_pool *pool)
+{
+	uint32_t count = strpool_count(pool);
+	size_t buf_size = 256;
+	char *buf = malloc(buf_size);
+	uint32_t i;
+
+	table->pool = pool;
+	table->mask = table_capacity(count) - 1;
+	table->slots = calloc(table->mask + 1, sizeof(*table->slots));
+	if (!buf || !table->slots) {
+		free(buf);
+		return -1;
+	}
+
+	for (i = 0; i < count; i++) {
+		struct pool_string str;
+		const char *s;
+		size_t len;
+		uint32_t h, j;
+
+		/* strings outside the pool cannot be looked up */
+		if (strpool_get(pool, i, &str))
+			continue;
+		if (str.utf8) {
+			s = str.data;
+			len = str.len;
+		} else {
+			len = strpool_to_utf8(&str, buf, buf_size);
+			if (len >= buf_size) {
+				char *p = realloc(buf, len + 1);
+
+				if (!p) {
+					free(buf);
+					return -1;
+				}
+				buf = p;
+				buf_size = len + 1;
+				strpool_to_utf8(&str, buf, buf_size);
+			}
+			s = buf;
+		}
+
+		/* pools may contain duplicates: keep the first index */
+		h = hash_bytes(s, len);
+		for (j = h & table->mask; table->slots[j].index;
+		     j = (j + 1) & table->mask) {
+			struct pool_string other;
+
+			if (table->slots[j].hash != h ||
+			    strpool_get(pool, table->slots[j].index - 1,
+					&other))
+				continue;
+			if (strpool_equals(&other, s, len))
+				break;
+		}
+		if (!table->slots[j].index) {
+			table->slots[j].hash = h;
+			table->slots[j].index = i + 1;
+		}
+	}
+	free(buf);
+	return 0;
+}
+
+/* Return the string pool index of s, or -1 */
+static int64_t string_table_find(const struct string_table *table,
+				 const char *s, size_t len)
+{
+	uint32_t h = hash_bytes(s, len);
+	uint32_t j;
+
+	for (j = h & table->mask; table->slots[j].index;
+	     j = (j + 1) & table->mask) {
+		struct pool_string str;
+
+		if (table->slots[j].hash != h ||
+		    strpool_get(table->pool, table->slots[j].index - 1, &str))
+			continue;
+		if (strpool_equals(&str, s, len))
+			return table->slots[j].index - 1;
+	}
+	return -1;
+}
+
+static void insert_id(struct names *names, uint32_t key, uint32_t id)
+{
+	uint32_t j = hash_id(id >> 16, key) & names->id_mask;
+
+	for (; names->ids[j].key; j = (j + 1) & names->id_mask) {
+		if (names->ids[j].key == key + 1 &&
+		    names->ids[j].id >> 16 == id >> 16)
+			return; /* same resource, other config */
+	}
+	names->ids[j].key = key + 1;
+	names->ids[j].id = id;
+}
+
+static uint32_t find_id(const struct names *names, uint8_t package_id,
+			uint8_t type_id, uint32_t key)
+{
+	uint32_t type = (uint32_t)package_id << 8 | type_id;
+	uint32_t j = hash_id(type, key) & names->id_mask;
+
+	for (; names->ids[j].key; j = (j + 1) & names->id_mask) {
+		if (names->ids[j].key == key + 1 &&
+		    names->ids[j].id >> 16 == type)
+			return names->ids[j].id;
+	}
+	return 0;
+}
+
+/*
+ * Call fn for every entry in every type of every package. Return -1 if the
+ * types of a type spec cannot be loaded.
+ */
+static int for_each_entry(const struct blob *blob,
+			  void (*fn)(uint32_t id, uint32_t key, void *data),
+			  void *data, struct error *err)
+{
+	uint32_t i;
+
+	for (i = 0; i < dtohl(blob->header->data.package_count); i++) {
+		const struct package *pkg = &blob->packages[i];
+		uint8_t pkg_id = dtohl(pkg->package->data.id);
+		size_t j, k;
+
+		for (j = 0; j < pkg->spec_count; j++) {
+			struct type_spec *spec = &pkg->specs[j];
+			uint32_t count = dtohl(spec->spec->data.entry_count);
+			uint8_t type_id = spec->spec->data.id;
+
+			if (blob_load_types(blob, spec, err))
+				return -1;
+			/* entry ids are 16 bits */
+			if (count > 0x10000)
+				count = 0x10000;
+			for (k = 0; k < spec->type_count; k++) {
+				const struct arsc_type *type = spec->types[k];
+				uint32_t e;
+
+				for (e = 0; e < count; e++) {
+					const struct arsc_entry *entry =
+						resource_type_entry(type, e);
+					if (entry)
+						fn(RESOURCE_ID(pkg_id, type_id,
+							       e),
+						   dtohl(entry->key), data);
+				}
+			}
+		}
+	}
+	return 0;
+}
+
+/*
+ * The number of distinct resource ids: every config of a resource shares
+ * its id, so the entry counts of the type specs bound the number of ids,
+ * however many configs there are.
+ */
+static size_t count_ids(const struct blob *blob)
+{
+	size_t count = 0;
+	uint32_t i;
+	size_t j;
+
+	for (i = 0; i < dtohl(blob->header->data.package_count); i++) {
+		const struct package *pkg = &blob->packages[i];
+
+		for (j = 0; j < pkg->spec_count; j++) {
+			const struct type_spec *spec = &pkg->specs[j];
+			uint32_t n = dtohl(spec->spec->data.entry_count);
+
+			count += n > 0x10000 ? 0x10000 : n;
+		}
+	}
+	return count;
+}
+
+static void add_entry(uint32_t id, uint32_t key, void *data)
+{
+	insert_id(data, key, id);
+}
+
+struct names *names_create(const struct blob *blob, struct error *err)
+{
+	struct names *names = calloc(1, sizeof(*names));
+	size_t i;
+
+	if (!names)
+		goto nomem;
+	names->packages = calloc(dtohl(blob->header->data.package_count),
+				 sizeof(struct names_package));
+	if (!names->packages)
+		goto nomem;
+	names->package_count = dtohl(blob->header->data.package_count);
+	for (i = 0; i < names->package_count; i++) {
+		const struct package *pkg = &blob->packages[i];
+		struct names_package *np = &names->packages[i];
+
+		np->package = pkg->package;
+		np->id = dtohl(pkg->package->data.id);
+		np->type_id_offset = resource_type_id_offset(pkg);
+		if (string_table_init(&np->types, pkg->sp_type_names) ||
+		    string_table_init(&np->keys, pkg->sp_resource_names))
+			goto nomem;
+	}
+
+	names->id_mask = table_capacity(count_ids(blob)) - 1;
+	names->ids = calloc(names->id_mask + 1, sizeof(*names->ids));
+	if (!names->ids)
+		goto nomem;
+	if (for_each_entry(blob, add_entry, names, err)) {
+		names_destroy(names);
+		return NULL;
+	}
+
+	return names;
+
+nomem:
+	error_set(err, ERROR_NOMEM, 0, "out of memory");
+	if (names)
+		names_destroy(names);
+	return NULL;
+}
+
+/*
+ * Serialized form, in host byte order:
+ *
+ *   struct saved_header
+ *   struct saved_package[package_count]
+ *   for each package: the type name slots, then the resource name slots
+ *   the id slots
+ *
+ * The slot arrays are stored exactly as in memory, so names_load can use
+ * them in place.
+ */
+#define NAMES_MAGIC 0x4d4e5241 /* "ARNM" */
+
+struct saved_header {
+	uint32_t magic;
+	uint32_t package_count;
+	uint32_t id_mask;
+	uint32_t reserved;
+};
+
+struct saved_package {
+	uint32_t id;
+	uint32_t type_id_offset;
+	uint32_t types_mask;
+	uint32_t keys_mask;
+};
+
+void *names_save(const struct names *names, size_t *size)
+{
+	struct saved_header *header;
+	struct saved_package *saved;
+	uint8_t *buf, *p;
+	size_t i, n;
+
+	n = sizeof(*header) + names->package_count * sizeof(*saved) +
+		(names->id_mask + 1) * sizeof(struct id_slot);
+	for (i = 0; i < names->package_count; i++)
+		n += (names->packages[i].types.mask + 1 +
+		      names->packages[i].keys.mask + 1) *
+			sizeof(struct string_slot);
+
+	buf = xmalloc(n);
+	header = (struct saved_header *)buf;
+	header->magic = NAMES_MAGIC;
+	header->package_count = names->package_count;
+	header->id_mask = names->id_mask;
+	header->reserved = 0;
+	saved = (struct saved_package *)(header + 1);
+	p = (uint8_t *)(saved + names->package_count);
+	for (i = 0; i < names->package_count; i++) {
+		const struct names_package *np = &names->packages[i];
+		size_t types_size = (np->types.mask + 1) *
+			sizeof(struct string_slot);
+		size_t keys_size = (np->keys.mask + 1) *
+			sizeof(struct string_slot);
+
+		saved[i].id = np->id;
+		saved[i].type_id_offset = np->type_id_offset;
+		saved[i].types_mask = np->types.mask;
+		saved[i].keys_mask = np->keys.mask;
+		memcpy(p, np->types.slots, types_size);
+		p += types_size;
+		memcpy(p, np->keys.slots, keys_size);
+		p += keys_size;
+	}
+	memcpy(p, names->ids, (names->id_mask + 1) * sizeof(struct id_slot));
+
+	*size = n;
+	return buf;
+}
+
+/*
+ * Take the slots of a string table from buf, checking that they fit, only
+ * refer to strings in pool, and leave an empty slot to end each probe.
+ */
+static int load_string_table(struct string_table *table,
+			     const struct arsc_string_pool *pool,
+			     uint32_t mask, const uint8_t **p,
+			     const uint8_t *end)
+{
+	uint32_t count = strpool_count(pool);
+	uint32_t i, empty = 0;
+
+	if (mask & (mask + 1) || mask == UINT32_MAX ||
+	    (size_t)(end - *p) / sizeof(struct string_slot) < mask + 1)
+		return -1;
+	table->pool = pool;
+	table->mask = mask;
+	table->slots = (struct string_slot *)*p;
+	for (i = 0; i <= mask; i++) {
+		if (table->slots[i].index > count)
+			return -1;
+		empty += !table->slots[i].index;
+	}
+	if (!empty)
+		return -1;
+	*p += (mask + 1) * sizeof(struct string_slot);
+	return 0;
+}
+
+struct names *names_load(const struct blob *blob, const void *buf,
+			 size_t size)
+{
+	const struct saved_header *header = buf;
+	const struct saved_package *saved;
+	const uint8_t *p, *end = (const uint8_t *)buf + size;
+	struct names *names;
+	size_t i;
+
+	if (size < sizeof(*header) || header->magic != NAMES_MAGIC ||
+	    header->package_count != dtohl(blob->header->data.package_count) ||
+	    (size - sizeof(*header)) / sizeof(*saved) < header->package_count)
+		return NULL;
+	saved = (const struct saved_package *)(header + 1);
+
+	names = malloc(sizeof(*names));
+	if (!names)
+		return NULL;
+	names->package_count = header->package_count;
+	names->packages = calloc(names->package_count,
+				 sizeof(struct names_package));
+	if (!names->packages)
+		goto fail;
+	names->loaded = 1;
+	p = (const uint8_t *)(saved + names->package_count);
+	for (i = 0; i < names->package_count; i++) {
+		const struct package *pkg = &blob->packages[i];
+		struct names_package *np = &names->packages[i];
+
+		np->package = pkg->package;
+		np->id = saved[i].id;
+		np->type_id_offset = saved[i].type_id_offset;
+		if (np->id != dtohl(pkg->package->data.id) ||
+		    load_string_table(&np->types, pkg->sp_type_names,
+				      saved[i].types_mask, &p, end) ||
+		    load_string_table(&np->keys, pkg->sp_resource_names,
+				      saved[i].keys_mask, &p, end))
+			goto fail;
+	}
+
+	names->id_mask = header->id_mask;
+	if (names->id_mask & (names->id_mask + 1) ||
+	    (size_t)(end - p) / sizeof(struct id_slot) !=
+	    (size_t)names->id_mask + 1)
+		goto fail;
+	names->ids = (struct id_slot *)p;
+	for (i = 0; i <= names->id_mask; i++)
+		if (!names->ids[i].key)
+			return names;
+
+fail:
+	free(names->packages);
+	free(names);
+	return NULL;
+}
+
+void names_destroy(struct names *names)
+{
+	size_t i;
+
+	if (names->loaded) {
+		free(names->packages);
+		free(names);
+		return;
+	}
+	for (i = 0; i < names->package_count; i++) {
+		free(names->packages[i].types.slots);
+		free(names->packages[i].keys.slots);
+	}
+	free(names->packages);
+	free(names->ids);
+	free(names);
+}
+
+static int package_name_equals(const struct arsc_package *package,
+			       const char *s, size_t len)
+{
+	const uint16_t *name = package->data.name;
+	struct pool_string str = { name, 0, 0 };
+	size_t max = sizeof(package->data.name) / sizeof(uint16_t);
+
+	while (str.len < max && name[str.len])
+		str.len++;
+	return strpool_equals(&str, s, len);
+}
+
+uint32_t names_lookup(const struct names *names, const char *name)
+{
+	const char *package = NULL, *type = name, *key;
+	size_t package_len = 0, type_len;
+	const char *p;
+	size_t i;
+
+	p = strchr(name, ':');
+	if (p) {
+		package = name;
+		package_len = p - name;
+		type = p + 1;
+	}
+	key = strchr(type, '/');
+	if (!key)
+		return 0;
+	type_len = key - type;
+	key++;
+
+	for (i = 0; i < names->package_count; i++) {
+		const struct names_package *np = &names->packages[i];
+		int64_t type_index, key_index;
+		uint32_t id;
+
+		if (package &&
+		    !package_name_equals(np->package, package, package_len))
+			continue;
+		type_index = string_table_find(&np->types, type, type_len);
+		if (type_index < 0)
+			continue;
+		key_index = string_table_find(&np->keys, key, strlen(key));
+		if (key_index < 0)
+			continue;
+		/* type strings are indexed by type id - 1 - type id offset */
+		id = find_id(names, np->id,
+			     type_index + 1 + np->type_id_offset, key_index);
+		if (id)
+			return id;
+	}
+	return 0;
+}
@@ -0,0 +1,41 @@
+#ifndef ARSC_NAMES_H
+#define ARSC_NAMES_H
+#include <stdint.h>
+
+struct blob;
+struct error;
+struct names;
+
+/*
+ * Build an index from resource names to resource ids. The index refers to
+ * the blob's string pools and must not outlive the blob. Return NULL and
+ * fill in err if the types of the blob cannot be loaded, or if out of
+ * memory.
+ */
+struct names *names_create(const struct blob *blob, struct error *err);
+void names_destroy(struct names *names);
+
+/*
+ * Serialize names into a buffer of *size bytes, to be freed with free().
+ * The buffer refers to the blob's string pools by index only, so it can be
+ * stored and later loaded for another mapping of the same blob.
+ */
+void *names_save(const struct names *names, size_t *size);
+
+/*
+ * Load names saved by names_save for the same blob. The saved tables are
+ * used in place, so buf must outlive the returned names. Return NULL if
+ * buf does not fit the blob.
+ */
+struct names *names_load(const struct blob *blob, const void *buf,
+			 size_t size);
+
+/*
+ * Look up a resource by name, on the form "[package:]type/name", e.g.
+ * "string/app_name" or "com.example:string/app_name". Without a package,
+ * packages are searched in blob order. Return the resource id, or 0 if
+ * there is no such resource.
+ */
+uint32_t names_lookup(const struct names *names, const char *name);
+
+#endif
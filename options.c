@@ -28,11 +28,35 @@ static void assign_value(const struct option_spec *spec, const char *value)
 	}
 }
 
-static void parse_short_option(const struct option_spec *specs, const char *key)
+/*
+ * Parse the short options in arg, e.g. "-b", "-j4" or "-bj 4": bools may be
+ * grouped, and an option that takes a value takes the rest of arg, or else
+ * next. Return the number of arguments used from next, 0 or 1.
+ */
+static int parse_short_options(const struct option_spec *specs,
+			       const char *arg, const char *next)
 {
-	(void)specs;
-	(void)key;
-	die("not implemented (yet)");
+	const struct option_spec *spec;
+
+	for (arg++; *arg; arg++) {
+		for (spec = specs; spec->type != OPT_TYPE_END; spec++) {
+			if (spec->short_key == *arg)
+				break;
+		}
+		die_if(spec->type == OPT_TYPE_END,
+		       "unknown option '-%c'", *arg);
+		if (spec->type == OPT_TYPE_BOOL) {
+			assign_value(spec, NULL);
+			continue;
+		}
+		if (arg[1]) {
+			assign_value(spec, arg + 1);
+			return 0;
+		}
+		assign_value(spec, next);
+		return 1;
+	}
+	return 0;
 }
 
 static void parse_long_option(const struct option_spec *specs, char *key)
@@ -57,16 +81,18 @@ static void parse_long_option(const struct option_spec *specs, char *key)
 int parse_options(const struct option_spec *specs, int argc, char **argv)
 {
 	int i;
-	const char *arg;
+	const char *arg, *next;
 
 	for (i = 0; i < argc; i++) {
 		arg = argv[i];
 
-		if (arg[0] != '-')
+		/* a lone dash is an argument, as in "read from stdin" */
+		if (arg[0] != '-' || !arg[1])
 			break;
 
+		next = i + 1 < argc ? argv[i + 1] : NULL;
 		if (arg[1] != '-')
-			parse_short_option(specs, arg);
+			i += parse_short_options(specs, arg, next);
 		else
 			parse_long_option(specs, (char *)(arg + 2));
 	}
@@ -0,0 +1,245 @@
+#include "arsc.h"
+#include "blob.h"
+#include "common.h"
+#include "config.h"
+#include "error.h"
+#include "resource.h"
+#include "strpool.h"
+
+/* A spec whose types cannot be loaded is treated as not found */
+static const struct type_spec *loaded(const struct blob *blob,
+				      struct type_spec *spec)
+{
+	struct error err;
+
+	return blob_load_types(blob, spec, &err) ? NULL : spec;
+}
+
+const struct type_spec *resource_find_spec(const struct blob *blob,
+					   uint8_t package_id,
+					   uint8_t type_id)
+{
+	uint32_t i;
+
+	for (i = 0; i < dtohl(blob->header->data.package_count); i++) {
+		const struct package *pkg = &blob->packages[i];
+		size_t j;
+
+		if (dtohl(pkg->package->data.id) != package_id)
+			continue;
+
+		/* type ids are usually dense and start at 1 */
+		if (type_id > 0 && type_id <= pkg->spec_count &&
+		    pkg->specs[type_id - 1].spec->data.id == type_id)
+			return loaded(blob, &pkg->specs[type_id - 1]);
+
+		for (j = 0; j < pkg->spec_count; j++) {
+			if (pkg->specs[j].spec->data.id == type_id)
+				return loaded(blob, &pkg->specs[j]);
+		}
+		return NULL;
+	}
+	return NULL;
+}
+
+uint32_t resource_type_id_offset(const struct package *pkg)
+{
+	/* older packages lack the type id offset field */
+	if (dtohs(pkg->package->header.header_size) < sizeof(*pkg->package))
+		return 0;
+	return dtohl(pkg->package->data.type_id_offset);
+}
+
+int resource_type_name(const struct package *pkg, uint8_t type_id,
+		       struct pool_string *name)
+{
+	uint32_t offset = resource_type_id_offset(pkg);
+
+	/* type strings are indexed by type id - 1 - type id offset */
+	if (type_id <= offset)
+		return -1;
+	return strpool_get(pkg->sp_type_names, type_id - 1 - offset, name);
+}
+
+static uint32_t sparse_entry_offset(const struct arsc_sparse_entry *entries,
+				    uint32_t count, uint16_t index)
+{
+	uint32_t lo = 0, hi = count;
+
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+		uint16_t idx = dtohs(entries[mid].idx);
+
+		if (idx == index)
+			return dtohs(entries[mid].offset) * 4;
+		if (idx < index)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return ARSC_NO_ENTRY;
+}
+
+/*
+ * Check that the entry at offset in type, and its value or map, lie within
+ * the type chunk. All arithmetic is done on sizes left in the chunk, so
+ * that it cannot wrap.
+ */
+static int check_entry(const struct arsc_type *type, uint64_t offset)
+{
+	size_t size = dtohl(type->header.size);
+	const struct arsc_entry *entry;
+	size_t left, entry_size;
+
+	if (offset % 4 != 0 || offset > size ||
+	    size - offset < sizeof(struct arsc_entry))
+		return -1;
+	entry = (const struct arsc_entry *)((const uint8_t *)type + offset);
+	left = size - offset;
+	entry_size = dtohs(entry->size);
+	if (dtohs(entry->flags) & ARSC_ENTRY_FLAG_COMPLEX) {
+		const struct arsc_map_entry *m =
+			(const struct arsc_map_entry *)entry;
+
+		if (entry_size < sizeof(*m) || entry_size > left)
+			return -1;
+		return (left - entry_size) / sizeof(struct arsc_map) <
+			dtohl(m->count) ? -1 : 0;
+	}
+	if (entry_size < sizeof(*entry) || entry_size > left ||
+	    left - entry_size < sizeof(struct arsc_value))
+		return -1;
+	return 0;
+}
+
+const struct arsc_entry *resource_type_entry(const struct arsc_type *type,
+					     uint16_t index)
+{
+	const uint8_t *base = (const uint8_t *)type;
+	size_t header_size = dtohs(type->header.header_size);
+	const void *table = base + header_size;
+	uint32_t count = dtohl(type->data.entry_count);
+	uint64_t offset;
+
+	/* both kinds of offset table have 4 byte elements */
+	if (header_size > dtohl(type->header.size) ||
+	    (dtohl(type->header.size) - header_size) / 4 < count)
+		return NULL;
+	if (type->data.res0 & ARSC_TYPE_FLAG_SPARSE) {
+		offset = sparse_entry_offset(table, count, index);
+	} else {
+		if (index >= count)
+			return NULL;
+		offset = dtohl(((const uint32_t *)table)[index]);
+	}
+	if (offset == ARSC_NO_ENTRY)
+		return NULL;
+
+	offset += dtohl(type->data.entries_start);
+	if (check_entry(type, offset))
+		return NULL;
+	return (const struct arsc_entry *)(base + offset);
+}
+
+/* entry has been checked by resource_type_entry */
+static void fill_entry(struct resource_entry *e, const struct arsc_type *type,
+		       const struct arsc_entry *entry)
+{
+	e->type = type;
+	e->entry = entry;
+	if (dtohs(entry->flags) & ARSC_ENTRY_FLAG_COMPLEX)
+		e->value = NULL;
+	else
+		e->value = (const struct arsc_value *)
+			((const uint8_t *)entry + dtohs(entry->size));
+}
+
+size_t resource_lookup(const struct blob *blob, uint32_t id,
+		       struct resource_entry *entries, size_t max)
+{
+	const struct type_spec *spec;
+	uint16_t index = RESOURCE_ENTRY_ID(id);
+	size_t i, n = 0;
+
+	spec = resource_find_spec(blob, RESOURCE_PACKAGE_ID(id),
+				  RESOURCE_TYPE_ID(id));
+	if (!spec || index >= dtohl(spec->spec->data.entry_count))
+		return 0;
+
+	for (i = 0; i < spec->type_count; i++) {
+		const struct arsc_type *type = spec->types[i];
+		const struct arsc_entry *entry;
+
+		entry = resource_type_entry(type, index);
+		if (!entry)
+			continue;
+		if (n < max)
+			fill_entry(&entries[n], type, entry);
+		n++;
+	}
+	return n;
+}
+
+/*
+ * Return the index of the best matching type in spec that defines entry
+ * index (or any type, if index is negative), or -1 if there is none.
+ * Types with a default config (mask 0) always match, and if no type in the
+ * spec uses a qualifier, the first matching type is the best one.
+ */
+static ssize_t select_type(const struct type_spec *spec, int index,
+			   const struct arsc_config *target)
+{
+	ssize_t best = -1;
+	size_t i;
+
+	for (i = 0; i < spec->type_count; i++) {
+		const struct arsc_type *type = spec->types[i];
+		uint32_t mask = spec->config_masks[i];
+
+		if (mask && !config_match(&type->data.config, mask, target))
+			continue;
+		if (index >= 0 && !resource_type_entry(type, index))
+			continue;
+		if (best < 0) {
+			best = i;
+			if (!spec->config_mask)
+				break;
+		} else if (config_is_better(&type->data.config,
+					    &spec->types[best]->data.config,
+					    mask | spec->config_masks[best],
+					    target)) {
+			best = i;
+		}
+	}
+	return best;
+}
+
+const struct arsc_type *resource_select_type(const struct type_spec *spec,
+					     const struct arsc_config *target)
+{
+	ssize_t i = select_type(spec, -1, target);
+
+	return i < 0 ? NULL : spec->types[i];
+}
+
+int resource_resolve(const struct blob *blob, uint32_t id,
+		     const struct arsc_config *target,
+		     struct resource_entry *entry)
+{
+	const struct type_spec *spec;
+	uint16_t index = RESOURCE_ENTRY_ID(id);
+	const struct arsc_type *type;
+	ssize_t i;
+
+	spec = resource_find_spec(blob, RESOURCE_PACKAGE_ID(id),
+				  RESOURCE_TYPE_ID(id));
+	if (!spec || index >= dtohl(spec->spec->data.entry_count))
+		return -1;
+
+	i = select_type(spec, index, target);
+	if (i < 0)
+		return -1;
+	type = spec->types[i];
+	fill_entry(entry, type, resource_type_entry(type, index));
+	return 0;
+}
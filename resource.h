@@ -0,0 +1,89 @@
+#ifndef ARSC_RESOURCE_H
+#define ARSC_RESOURCE_H
+#include <stddef.h>
+#include <stdint.h>
+
+struct arsc_config;
+struct arsc_entry;
+struct arsc_type;
+struct arsc_value;
+struct blob;
+struct package;
+struct pool_string;
+struct type_spec;
+
+#define RESOURCE_PACKAGE_ID(id) (((id) >> 24) & 0xff)
+#define RESOURCE_TYPE_ID(id) (((id) >> 16) & 0xff)
+#define RESOURCE_ENTRY_ID(id) ((id) & 0xffff)
+#define RESOURCE_ID(pkg, type, entry) \
+	((uint32_t)(pkg) << 24 | (uint32_t)(type) << 16 | (uint32_t)(entry))
+
+/*
+ * One configuration of a resource. All pointers point into the
+ * resources.arsc blob. value is NULL for complex (map) entries.
+ */
+struct resource_entry {
+	const struct arsc_type *type;
+	const struct arsc_entry *entry;
+	const struct arsc_value *value;
+};
+
+/*
+ * Find the type spec for the given package and type id, or NULL. The types
+ * of the spec are loaded if the blob was set up from an index; a spec
+ * whose type chunks turn out to be malformed is not found.
+ */
+const struct type_spec *resource_find_spec(const struct blob *blob,
+					   uint8_t package_id,
+					   uint8_t type_id);
+
+/*
+ * The type id offset of pkg: type name strings are indexed by type id - 1
+ * - offset. Packages written before the field existed have an offset of
+ * 0.
+ */
+uint32_t resource_type_id_offset(const struct package *pkg);
+
+/*
+ * Look up the name of type type_id in package pkg. Return 0 on success, or
+ * -1 if the package has no name for the type.
+ */
+int resource_type_name(const struct package *pkg, uint8_t type_id,
+		       struct pool_string *name);
+
+/*
+ * Find the entry with the given index in a type chunk, or NULL if the type
+ * does not define it. Entries that do not fit in the chunk, along with
+ * their value or, for complex entries, their maps, are treated as not
+ * defined, so callers can read those without further checks.
+ */
+const struct arsc_entry *resource_type_entry(const struct arsc_type *type,
+					     uint16_t index);
+
+/*
+ * Find all configurations of the resource with the given id (0xPPTTEEEE).
+ * Store at most max of them in entries and return the number of
+ * configurations found, which may be larger than max. Nothing is
+ * allocated.
+ */
+size_t resource_lookup(const struct blob *blob, uint32_t id,
+		       struct resource_entry *entries, size_t max);
+
+/*
+ * Pick the type in spec whose config best matches target, following the
+ * framework's precedence rules. Return NULL if no type matches. The types
+ * of spec must be loaded, as they are for specs from resource_find_spec.
+ */
+const struct arsc_type *resource_select_type(const struct type_spec *spec,
+					     const struct arsc_config *target);
+
+/*
+ * Resolve the resource with the given id for the target device config:
+ * among the configurations that define the resource, store the best match
+ * in entry. Return 0 on success, or -1 if no configuration matches.
+ */
+int resource_resolve(const struct blob *blob, uint32_t id,
+		     const struct arsc_config *target,
+		     struct resource_entry *entry);
+
+#endif
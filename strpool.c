@@ -0,0 +1,184 @@
+#include <string.h>
+
+#include "arsc.h"
+#include "common.h"
+#include "strpool.h"
+
+uint32_t strpool_count(const struct arsc_string_pool *pool)
+{
+	return dtohl(pool->data.string_count);
+}
+
+int strpool_is_utf8(const struct arsc_string_pool *pool)
+{
+	return (dtohl(pool->data.flags) & ARSC_STRING_POOL_UTF8) != 0;
+}
+
+/*
+ * String lengths are stored as a variable length prefix: UTF-8 pools use
+ * one or two bytes (high bit set means a second byte follows), UTF-16 pools
+ * one or two uint16_t (high bit set means a second uint16_t follows).
+ */
+static const uint8_t *decode_length8(const uint8_t *p, size_t *len)
+{
+	if (p[0] & 0x80) {
+		*len = ((p[0] & 0x7f) << 8) | p[1];
+		return p + 2;
+	}
+	*len = p[0];
+	return p + 1;
+}
+
+static const uint16_t *decode_length16(const uint16_t *p, size_t *len)
+{
+	uint16_t hi = dtohs(p[0]);
+
+	if (hi & 0x8000) {
+		*len = ((size_t)(hi & 0x7fff) << 16) | dtohs(p[1]);
+		return p + 2;
+	}
+	*len = hi;
+	return p + 1;
+}
+
+/*
+ * The pool header has been checked by the parser, but the offsets and
+ * lengths of the strings have not: check each string against the end of
+ * the pool, doing the arithmetic on remaining sizes so that it cannot
+ * overflow.
+ */
+int strpool_get(const struct arsc_string_pool *pool, uint32_t index,
+		struct pool_string *str)
+{
+	const uint8_t *base = (const uint8_t *)pool;
+	size_t size = dtohl(pool->header.size);
+	const uint32_t *offsets;
+	const uint8_t *p, *end = base + size;
+	uint64_t offset;
+	size_t len;
+
+	if (index >= dtohl(pool->data.string_count) ||
+	    dtohs(pool->header.header_size) + 4 * ((uint64_t)index + 1) > size)
+		return -1;
+
+	offsets = (const uint32_t *)(base + dtohs(pool->header.header_size));
+	offset = (uint64_t)dtohl(pool->data.strings_start) +
+		dtohl(offsets[index]);
+	/* every string has at least a length and a terminating NUL */
+	if (offset + 2 > size)
+		return -1;
+	p = base + offset;
+
+	if (strpool_is_utf8(pool)) {
+		/* skip the UTF-16 length; the UTF-8 byte count follows it */
+		p = decode_length8(p, &len);
+		if (end - p < 2)
+			return -1;
+		p = decode_length8(p, &str->len);
+		if ((size_t)(end - p) <= str->len)
+			return -1;
+		str->utf8 = 1;
+	} else {
+		if (dtohs(*(const uint16_t *)p) & 0x8000 && offset + 4 > size)
+			return -1;
+		p = (const uint8_t *)decode_length16((const uint16_t *)p,
+						     &str->len);
+		if ((size_t)(end - p) / 2 <= str->len)
+			return -1;
+		str->utf8 = 0;
+	}
+	str->data = p;
+	return 0;
+}
+
+static size_t encode_utf8(uint32_t c, char out[4])
+{
+	if (c < 0x80) {
+		out[0] = c;
+		return 1;
+	}
+	if (c < 0x800) {
+		out[0] = 0xc0 | (c >> 6);
+		out[1] = 0x80 | (c & 0x3f);
+		return 2;
+	}
+	if (c < 0x10000) {
+		out[0] = 0xe0 | (c >> 12);
+		out[1] = 0x80 | ((c >> 6) & 0x3f);
+		out[2] = 0x80 | (c & 0x3f);
+		return 3;
+	}
+	out[0] = 0xf0 | (c >> 18);
+	out[1] = 0x80 | ((c >> 12) & 0x3f);
+	out[2] = 0x80 | ((c >> 6) & 0x3f);
+	out[3] = 0x80 | (c & 0x3f);
+	return 4;
+}
+
+static uint32_t next_code_point(const uint16_t *s, size_t len, size_t *i)
+{
+	uint32_t c = dtohs(s[*i]);
+
+	(*i)++;
+	if (c >= 0xd800 && c < 0xdc00 && *i < len) {
+		uint32_t lo = dtohs(s[*i]);
+		if (lo >= 0xdc00 && lo < 0xe000) {
+			c = 0x10000 + ((c - 0xd800) << 10) + (lo - 0xdc00);
+			(*i)++;
+		}
+	}
+	return c;
+}
+
+size_t strpool_to_utf8(const struct pool_string *str, char *buf, size_t size)
+{
+	const uint16_t *s = str->data;
+	size_t i, n = 0;
+
+	if (str->utf8) {
+		if (size > 0) {
+			n = str->len < size - 1 ? str->len : size - 1;
+			memcpy(buf, str->data, n);
+			buf[n] = '\0';
+		}
+		return str->len;
+	}
+
+	for (i = 0; i < str->len;) {
+		uint32_t c = next_code_point(s, str->len, &i);
+		char tmp[4];
+		size_t len;
+
+		len = encode_utf8(c, tmp);
+		if (n + len < size)
+			memcpy(buf + n, tmp, len);
+		else if (n < size)
+			size = n + 1; /* never emit a partial code point */
+		n += len;
+	}
+	if (size > 0)
+		buf[n < size ? n : size - 1] = '\0';
+	return n;
+}
+
+int strpool_equals(const struct pool_string *str, const char *s, size_t len)
+{
+	const uint16_t *p = str->data;
+	size_t i, n = 0;
+
+	if (str->utf8)
+		return str->len == len && !memcmp(str->data, s, len);
+
+	/* each UTF-16 code unit encodes to at least one UTF-8 byte */
+	if (str->len > len)
+		return 0;
+	for (i = 0; i < str->len;) {
+		char tmp[4];
+		size_t k = encode_utf8(next_code_point(p, str->len, &i), tmp);
+
+		if (n + k > len || memcmp(s + n, tmp, k))
+			return 0;
+		n += k;
+	}
+	return n == len;
+}
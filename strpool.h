@@ -0,0 +1,44 @@
+#ifndef ARSC_STRPOOL_H
+#define ARSC_STRPOOL_H
+#include <stddef.h>
+#include <stdint.h>
+
+struct arsc_string_pool;
+
+/*
+ * A string stored in a string pool. The data pointer points straight into
+ * the resources.arsc blob; nothing is copied. For UTF-8 pools, data is len
+ * bytes followed by a NUL byte. For UTF-16 pools, data is len uint16_t code
+ * units in device byte order (use dtohs) followed by a NUL code unit.
+ */
+struct pool_string {
+	const void *data;
+	size_t len;
+	int utf8;
+};
+
+uint32_t strpool_count(const struct arsc_string_pool *pool);
+int strpool_is_utf8(const struct arsc_string_pool *pool);
+
+/*
+ * Look up the string at the given index. Return 0 on success, or -1 if
+ * index is out of range or the string does not fit in the pool. O(1): the
+ * pool's offset table is indexed directly.
+ */
+int strpool_get(const struct arsc_string_pool *pool, uint32_t index,
+		struct pool_string *str);
+
+/*
+ * Write str as a NUL terminated UTF-8 string to buf. Behaves like snprintf:
+ * at most size bytes are written, and the return value is the length the
+ * full string would have had.
+ */
+size_t strpool_to_utf8(const struct pool_string *str, char *buf, size_t size);
+
+/*
+ * Return non-zero if str equals the UTF-8 string s of length len. UTF-16
+ * strings are compared without converting them to a buffer first.
+ */
+int strpool_equals(const struct pool_string *str, const char *s, size_t len);
+
+#endif
@@ -0,0 +1,271 @@
+/*
+ * Micro-benchmarks for map_file, blob_init, blob_destroy and
+ * config_to_string over a corpus of apk and resources.arsc files.
+ *
+ * Each benchmark is run --warmup times untimed, then --repeat times with
+ * --iterations operations each. For every benchmark and file, the fastest
+ * and the median repetition are reported, together with allocations per
+ * operation and throughput.
+ *
+ * Allocations are counted by wrapping malloc, calloc and realloc at link
+ * time (-Wl,--wrap=...; see the bench target in the Makefile), so only
+ * calls made from objects linked into this binary are seen: allocations
+ * inside zlib are not counted.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "arsc.h"
+#include "blob.h"
+#include "common.h"
+#include "config.h"
+#include "filemap.h"
+#include "options.h"
+
+static size_t alloc_count;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *p, size_t size);
+
+void *__wrap_malloc(size_t size)
+{
+	alloc_count++;
+	return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size)
+{
+	alloc_count++;
+	return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *p, size_t size)
+{
+	alloc_count++;
+	return __real_realloc(p, size);
+}
+
+static struct {
+	int warmup;
+	int iterations;
+	int repeat;
+} bench_opts = { 10, 100, 5 };
+
+static struct option_spec bench_option_specs[] = {
+	OPT_INTEGER(0, "warmup", &bench_opts.warmup),
+	OPT_INTEGER(0, "iterations", &bench_opts.iterations),
+	OPT_INTEGER(0, "repeat", &bench_opts.repeat),
+	OPT_END,
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+ * The result of one repetition: the time spent in the measured calls, and
+ * the operations, allocations and bytes they accounted for.
+ */
+struct sample {
+	uint64_t ns;
+	size_t ops;
+	size_t allocs;
+	size_t bytes;
+};
+
+struct bench {
+	const char *name;
+	void (*run)(const char *path, int iterations, struct sample *s);
+};
+
+static void bench_map_file(const char *path, int iterations,
+			   struct sample *s)
+{
+	struct mapped_file map;
+	int i;
+
+	for (i = 0; i < iterations; i++) {
+		uint64_t t = now_ns();
+		size_t a = alloc_count;
+
+		map_file(path, &map);
+		s->ns += now_ns() - t;
+		s->allocs += alloc_count - a;
+		s->bytes += map.data_size;
+		s->ops++;
+		unmap_file(&map);
+	}
+}
+
+static void bench_blob_init(const char *path, int iterations,
+			    struct sample *s)
+{
+	struct mapped_file map;
+	struct blob *blob;
+	int i;
+
+	map_file(path, &map);
+	for (i = 0; i < iterations; i++) {
+		uint64_t t = now_ns();
+		size_t a = alloc_count;
+
+		blob_init(&blob, map.data, map.data_size);
+		s->ns += now_ns() - t;
+		s->allocs += alloc_count - a;
+		s->bytes += map.data_size;
+		s->ops++;
+		blob_destroy(blob);
+	}
+	unmap_file(&map);
+}
+
+/* blob_destroy is too quick to time one call at a time: time batches */
+#define DESTROY_BATCH 64
+
+static void bench_blob_destroy(const char *path, int iterations,
+			       struct sample *s)
+{
+	struct blob *blobs[DESTROY_BATCH];
+	struct mapped_file map;
+	int i, j, n;
+
+	map_file(path, &map);
+	for (i = 0; i < iterations; i += n) {
+		uint64_t t;
+		size_t a;
+
+		n = iterations - i < DESTROY_BATCH ?
+			iterations - i : DESTROY_BATCH;
+		for (j = 0; j < n; j++)
+			blob_init(&blobs[j], map.data, map.data_size);
+		t = now_ns();
+		a = alloc_count;
+		for (j = 0; j < n; j++)
+			blob_destroy(blobs[j]);
+		s->ns += now_ns() - t;
+		s->allocs += alloc_count - a;
+		s->bytes += n * map.data_size;
+		s->ops += n;
+	}
+	unmap_file(&map);
+}
+
+/* One operation formats every type's config once; bytes are output bytes */
+static void bench_config_to_string(const char *path, int iterations,
+				   struct sample *s)
+{
+	const struct arsc_config **configs;
+	struct mapped_file map;
+	struct blob *blob;
+	size_t n = 0, k;
+	uint32_t i;
+	int it;
+
+	map_file(path, &map);
+	blob_init(&blob, map.data, map.data_size);
+	for (i = 0; i < dtohl(blob->header->data.package_count); i++) {
+		const struct package *pkg = &blob->packages[i];
+
+		for (k = 0; k < pkg->spec_count; k++)
+			n += pkg->specs[k].type_count;
+	}
+	configs = xcalloc(n + 1, sizeof(*configs));
+	n = 0;
+	for (i = 0; i < dtohl(blob->header->data.package_count); i++) {
+		const struct package *pkg = &blob->packages[i];
+
+		for (k = 0; k < pkg->spec_count; k++) {
+			const struct type_spec *spec = &pkg->specs[k];
+			size_t t;
+
+			for (t = 0; t < spec->type_count; t++)
+				configs[n++] = &spec->types[t]->data.config;
+		}
+	}
+
+	for (it = 0; it < iterations; it++) {
+		char buf[CONFIG_LEN];
+		uint64_t t = now_ns();
+		size_t a = alloc_count;
+
+		for (k = 0; k < n; k++)
+			s->bytes += config_to_string(configs[k], buf);
+		s->ns += now_ns() - t;
+		s->allocs += alloc_count - a;
+		s->ops += n;
+	}
+
+	free(configs);
+	blob_destroy(blob);
+	unmap_file(&map);
+}
+
+static const struct bench benches[] = {
+	{ "map_file", bench_map_file },
+	{ "blob_init", bench_blob_init },
+	{ "blob_destroy", bench_blob_destroy },
+	{ "config_to_string", bench_config_to_string },
+};
+
+static double ns_per_op(const struct sample *s)
+{
+	return s->ops ? (double)s->ns / s->ops : 0;
+}
+
+static int compare_samples(const void *pa, const void *pb)
+{
+	double a = ns_per_op(pa), b = ns_per_op(pb);
+
+	return a < b ? -1 : a > b;
+}
+
+static void run_bench(const struct bench *b, const char *path)
+{
+	struct sample warmup, *samples, *best, *median;
+	int r;
+
+	memset(&warmup, 0, sizeof(warmup));
+	if (bench_opts.warmup > 0)
+		b->run(path, bench_opts.warmup, &warmup);
+
+	samples = xcalloc(bench_opts.repeat, sizeof(*samples));
+	for (r = 0; r < bench_opts.repeat; r++)
+		b->run(path, bench_opts.iterations, &samples[r]);
+	qsort(samples, bench_opts.repeat, sizeof(*samples), compare_samples);
+	best = &samples[0];
+	median = &samples[bench_opts.repeat / 2];
+
+	printf("%-40s %-18s %10.1f %10.1f %10.2f %10.1f\n", path, b->name,
+	       ns_per_op(best), ns_per_op(median),
+	       best->ops ? (double)best->allocs / best->ops : 0,
+	       best->ns ? best->bytes * 1e3 / best->ns : 0);
+	free(samples);
+}
+
+int main(int argc, char **argv)
+{
+	size_t i;
+	int f;
+
+	argc = parse_options(bench_option_specs, --argc, ++argv);
+	die_if(argc == 0 || bench_opts.iterations <= 0 ||
+	       bench_opts.repeat <= 0,
+	       "usage: bench [--warmup=<n>] [--iterations=<n>] "
+	       "[--repeat=<n>] <resource-file-or-apk>...");
+
+	printf("# warmup=%d iterations=%d repeat=%d\n", bench_opts.warmup,
+	       bench_opts.iterations, bench_opts.repeat);
+	printf("%-40s %-18s %10s %10s %10s %10s\n", "# file", "benchmark",
+	       "ns/op min", "ns/op med", "allocs/op", "MB/s");
+	for (f = 0; f < argc; f++)
+		for (i = 0; i < sizeof(benches) / sizeof(benches[0]); i++)
+			run_bench(&benches[i], argv[f]);
+	return 0;
+}
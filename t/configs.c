@@ -0,0 +1,31 @@
+/*
+ * Round trip test of config strings: each argument, written as
+ * config_to_string prints it, must parse with config_from_string and print
+ * back unchanged. Exit with status 1 if any does not.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "arsc.h"
+#include "config.h"
+
+int main(int argc, char **argv)
+{
+	struct arsc_config config;
+	char buf[CONFIG_LEN];
+	int i, ret = 0;
+
+	for (i = 1; i < argc; i++) {
+		if (config_from_string(argv[i], &config)) {
+			fprintf(stderr, "'%s' does not parse\n", argv[i]);
+			ret = 1;
+			continue;
+		}
+		config_to_string(&config, buf);
+		if (strcmp(argv[i], buf)) {
+			fprintf(stderr, "'%s' prints as '%s'\n", argv[i], buf);
+			ret = 1;
+		}
+	}
+	return ret;
+}
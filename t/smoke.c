@@ -0,0 +1,77 @@
+/*
+ * Smoke test of the public libarsc API, linked against libarsc.so so that
+ * only exported functions are reachable.
+ *
+ * For every configuration of every resource in each file: the name of the
+ * resource must look up its id, the config string must resolve the id
+ * back to a configuration with that same config string, and string values
+ * must be readable. Exit with status 1 on the first mismatch.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "libarsc.h"
+
+struct smoke {
+	const char *path;
+	const struct arsc_file *file;
+	size_t count;
+};
+
+static int check(const struct arsc_resource *res, void *data)
+{
+	struct smoke *s = data;
+	struct arsc_resource resolved;
+	char name[512], config[128], other[128], value[512];
+	uint32_t id;
+
+	if (arsc_resource_name(s->file, res, name, sizeof(name)) < 0) {
+		fprintf(stderr, "%s: 0x%08x: no name\n", s->path, res->id);
+		return -1;
+	}
+	id = arsc_find(s->file, name);
+	if (id != res->id) {
+		fprintf(stderr, "%s: %s: found 0x%08x, expected 0x%08x\n",
+			s->path, name, id, res->id);
+		return -1;
+	}
+	if (arsc_resource_config(res, config, sizeof(config)) < 0 ||
+	    arsc_resolve(s->file, res->id, config, &resolved) ||
+	    arsc_resource_config(&resolved, other, sizeof(other)) < 0 ||
+	    strcmp(config, other)) {
+		fprintf(stderr, "%s: %s: config '%s' resolves elsewhere\n",
+			s->path, name, config);
+		return -1;
+	}
+	if (res->data_type == ARSC_DATA_TYPE_STRING &&
+	    arsc_resource_string(s->file, res, value, sizeof(value)) < 0) {
+		fprintf(stderr, "%s: %s: bad string value %u\n", s->path,
+			name, res->data);
+		return -1;
+	}
+	s->count++;
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	struct arsc_error err;
+	struct arsc_file *file;
+	int i, ret;
+
+	for (i = 1; i < argc; i++) {
+		struct smoke s = { argv[i], NULL, 0 };
+
+		if (arsc_open(&file, argv[i], &err)) {
+			fprintf(stderr, "%s: %s\n", argv[i], err.message);
+			return 1;
+		}
+		s.file = file;
+		ret = arsc_foreach(file, check, &s);
+		arsc_close(file);
+		if (ret)
+			return 1;
+		printf("%s: %zu configurations ok\n", argv[i], s.count);
+	}
+	return 0;
+}
@@ -0,0 +1,106 @@
+#!/bin/sh
+#
+# Behaviour tests: t/test.sh <arsc> <smoke> <configs> [<file>...]
+#
+# Every qualifier must print back as it is parsed.
+#
+# Each file, and a few written by arsc gen, must dump the same with and
+# without a cache, and with --stream for the type lines; every config that
+# dump prints must parse back as a --config filter matching it; diff must
+# find no changes against the file itself; and the libarsc smoke test must
+# pass. Finally, diff must see the changes between two generated files.
+set -e
+
+arsc=$1
+smoke=$2
+configs=$3
+shift 3
+
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+fail()
+{
+	echo "FAIL: $*" >&2
+	exit 1
+}
+
+# every qualifier, and a combination written as config_to_string prints it
+"$configs" mcc310 mnc4 en US en-US ldltr ldrtl sw600dp w320dp h480dp \
+	small normal large xlarge notlong long port land square \
+	desk car television appliance watch notnight night \
+	ldpi mdpi tvdpi hdpi xhdpi xxhdpi xxxhdpi nodpi anydpi \
+	notouch stylus finger keysexposed keyshidden keyssoft \
+	nokeys qwerty 12key navexposed navhidden nonav dpad trackball wheel \
+	v21 en-US-sw600dp-land-watch-night-xhdpi-v21 ||
+	fail "configs do not print as they parse"
+
+"$arsc" gen --types=6 --configs=12 --entries=40 "$tmp/dense.arsc"
+"$arsc" gen --utf16 --sparse --fill=30 --types=4 --configs=8 \
+	--entries=60 "$tmp/sparse.arsc"
+"$arsc" gen --apk --packages=2 --types=3 --configs=5 --entries=20 \
+	"$tmp/stored.apk"
+# configs of an older format version: 28 bytes, up to the sdk version
+"$arsc" gen --config-size=28 --types=2 --configs=690 --entries=10 \
+	"$tmp/short.arsc"
+
+for f in "$tmp/dense.arsc" "$tmp/sparse.arsc" "$tmp/stored.apk" \
+	"$tmp/short.arsc" "$@"; do
+	name=${f##*/}
+
+	"$arsc" dump "$f" > "$tmp/dump"
+	# the first run stores the cache entry, the second one uses it
+	for run in miss hit; do
+		"$arsc" dump --cache-dir="$tmp/cache" "$f" > "$tmp/cached"
+		cmp -s "$tmp/dump" "$tmp/cached" ||
+			fail "$name: dump --cache-dir differs on a $run"
+	done
+
+	# --stream reads stored entries only, so deflated apks are skipped
+	grep '^type:' "$tmp/dump" > "$tmp/types"
+	if "$arsc" dump --stream "$f" > "$tmp/stream" 2> "$tmp/err"; then
+		cmp -s "$tmp/types" "$tmp/stream" ||
+			fail "$name: dump --stream differs"
+	elif ! grep -q 'is compressed' "$tmp/err"; then
+		cat "$tmp/err" >&2
+		fail "$name: dump --stream fails"
+	fi
+
+	sed -n 's/^type: .* config=//p' "$tmp/dump" | sort -u |
+	while read -r config; do
+		test "$config" = - && continue
+		"$arsc" dump --config="$config" "$f" |
+			grep -q -x "type: .* config=$config" ||
+			fail "$name: config $config does not parse back"
+	done
+
+	"$arsc" diff "$f" "$f" > /dev/null ||
+		fail "$name: diff against itself finds changes"
+
+	"$smoke" "$f" > /dev/null || fail "$name: smoke test"
+done
+
+# -j is short for --jobs, and --stdin takes no paths on the command line
+"$arsc" dump --jobs=2 "$tmp/dense.arsc" "$tmp/sparse.arsc" > "$tmp/long"
+"$arsc" dump -j 2 "$tmp/dense.arsc" "$tmp/sparse.arsc" > "$tmp/short"
+cmp -s "$tmp/long" "$tmp/short" || fail "dump -j differs from --jobs"
+echo "$tmp/dense.arsc" |
+	"$arsc" dump --stdin "$tmp/sparse.arsc" > /dev/null 2>&1 &&
+	fail "dump --stdin accepts paths on the command line"
+
+# one more entry per type spec: diff exits with 1 for changes, 2 on errors
+"$arsc" gen --types=6 --configs=12 --entries=41 "$tmp/more.arsc"
+status=0
+"$arsc" diff "$tmp/dense.arsc" "$tmp/more.arsc" > "$tmp/diff" || status=$?
+test $status = 1 || fail "diff of changed files exits with $status"
+grep -q '^summary: added=[1-9]' "$tmp/diff" ||
+	fail "diff of changed files reports no added resources"
+
+# the same short configs in a sparse type: only the entry tables, which
+# follow the configs, differ
+"$arsc" gen --config-size=28 --types=2 --configs=690 --entries=10 --sparse \
+	"$tmp/short-sparse.arsc"
+"$arsc" diff "$tmp/short.arsc" "$tmp/short-sparse.arsc" > /dev/null ||
+	fail "diff of short configs compares the bytes past their size"
+
+echo "all tests passed"
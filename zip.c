@@ -0,0 +1,781 @@
+#define _GNU_SOURCE /* memrchr */
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "common.h"
+#include "error.h"
+#include "zip.h"
+
+#define ZIP_LFH_MAGIC 0x04034b50
+#define ZIP_CD_MAGIC 0x02014b50
+#define ZIP_EOCD_MAGIC 0x06054b50
+#define ZIP64_EOCD_MAGIC 0x06064b50
+#define ZIP64_LOCATOR_MAGIC 0x07064b50
+
+#define ZIP64_EXTRA_ID 0x0001
+
+/* the EOCD is followed by a comment of at most this many bytes */
+#define ZIP_MAX_COMMENT_LENGTH 0xffff
+
+#define APK_SIG_BLOCK_MAGIC "APK Sig Block 42"
+
+/*
+ * Zip file parser.
+ *
+ * Basic zip format grammar: [LFH file-data]* [APK-SIG-BLOCK]? [CD]*
+ * [ZIP64-EOCD LOCATOR]? EOCD [comment]?. Fields that do not fit in the
+ * EOCD or a CD record are set to all ones and stored in the zip64 EOCD and
+ * the zip64 extra field of the CD record, respectively. Archives spanning
+ * several disks are not supported.
+ */
+
+/* stripped version of Local File Header */
+struct __attribute__ ((__packed__)) zip_lfh {
+	uint32_t magic;
+	uint8_t padding_1[4];
+	uint16_t compression_method;
+	uint8_t padding_2[8];
+	uint32_t compressed_size;
+	uint32_t uncompressed_size;
+	uint16_t filename_length;
+	uint16_t extra_length;
+	const char filename[0];
+};
+
+/* Central Directory record */
+struct __attribute__ ((__packed__)) zip_cd {
+	uint32_t magic;
+	uint16_t version_made_by;
+	uint16_t version_needed;
+	uint16_t flags;
+	uint16_t compression_method;
+	uint16_t mtime;
+	uint16_t mdate;
+	uint32_t crc32;
+	uint32_t compressed_size;
+	uint32_t uncompressed_size;
+	uint16_t filename_length;
+	uint16_t extra_length;
+	uint16_t comment_length;
+	uint8_t padding[8];
+	uint32_t lfh_offset;
+	const char filename[0];
+};
+
+/* stripped version of End of Central Directory record */
+struct __attribute__ ((__packed__)) zip_eocd {
+	uint32_t magic;
+	uint8_t padding_1[6];
+	uint16_t entry_count; /* assume zip only spans one disk */
+	uint32_t cd_size;
+	uint32_t cd_offset;
+	uint16_t comment_length;
+};
+
+/* stripped version of zip64 End of Central Directory locator */
+struct __attribute__ ((__packed__)) zip64_locator {
+	uint32_t magic;
+	uint32_t disk;
+	uint64_t eocd_offset;
+	uint32_t disk_count;
+};
+
+/* stripped version of zip64 End of Central Directory record */
+struct __attribute__ ((__packed__)) zip64_eocd {
+	uint32_t magic;
+	uint8_t padding_1[28];
+	uint64_t entry_count;
+	uint64_t cd_size;
+	uint64_t cd_offset;
+};
+
+/* APK Signing Block: uint64 size, pairs, then this footer */
+struct __attribute__ ((__packed__)) apk_sig_block_footer {
+	uint64_t size; /* size of the block, excluding the leading size */
+	char magic[16];
+};
+
+struct __attribute__ ((__packed__)) zip_extra {
+	uint16_t id;
+	uint16_t size;
+	uint8_t data[0];
+};
+
+int zip_is_zip(const void *map, size_t size)
+{
+	return size >= sizeof(uint32_t) &&
+		dtohl(*(const uint32_t *)map) == ZIP_LFH_MAGIC;
+}
+
+static uint32_t hash_name(const char *s, size_t len)
+{
+	uint32_t h = 2166136261u;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		h ^= (uint8_t)s[i];
+		h *= 16777619u;
+	}
+	return h;
+}
+
+/*
+ * The EOCD is the last record in the file, but may be followed by a
+ * comment. Scan the last 64 KiB backwards for the EOCD magic, using
+ * memrchr to skip quickly to each candidate 'P', and accept the first
+ * candidate whose comment length reaches exactly to the end of the file.
+ */
+static const struct zip_eocd *find_eocd(const uint8_t *map, size_t size,
+					struct error *err)
+{
+	const struct zip_eocd *eocd;
+	const uint8_t *start, *p;
+	size_t len;
+
+	if (size < sizeof(*eocd)) {
+		error_set(err, ERROR_FORMAT, 0, "zip file too small");
+		return NULL;
+	}
+
+	/* common case: no comment */
+	eocd = (struct zip_eocd *)(map + size - sizeof(*eocd));
+	if (dtohl(eocd->magic) == ZIP_EOCD_MAGIC &&
+	    dtohs(eocd->comment_length) == 0)
+		return eocd;
+
+	len = size - sizeof(*eocd);
+	if (len > ZIP_MAX_COMMENT_LENGTH)
+		len = ZIP_MAX_COMMENT_LENGTH;
+	start = map + size - sizeof(*eocd) - len;
+	/* search [start, start + len + 1) for the first byte of the magic */
+	len++;
+	while ((p = memrchr(start, 'P', len))) {
+		eocd = (const struct zip_eocd *)p;
+		if (dtohl(eocd->magic) == ZIP_EOCD_MAGIC &&
+		    p + sizeof(*eocd) + dtohs(eocd->comment_length) ==
+		    map + size)
+			return eocd;
+		len = p - start;
+	}
+
+	error_set(err, ERROR_FORMAT, size - sizeof(*eocd),
+		  "no zip eocd found");
+	return NULL;
+}
+
+/*
+ * Signed apks store an APK Signing Block right before the central
+ * directory. Its size is stored both at its start and in its footer; the
+ * two must agree, and the block must fit before the central directory.
+ */
+static int find_signing_block(struct zip *zip, uint64_t cd_offset,
+			      struct error *err)
+{
+	const struct apk_sig_block_footer *footer;
+	uint64_t size, offset, leading_size;
+
+	zip->signing_block_offset = 0;
+	zip->signing_block_size = 0;
+	if (cd_offset < sizeof(*footer))
+		return 0;
+	footer = (const struct apk_sig_block_footer *)
+		(zip->map + cd_offset - sizeof(*footer));
+	if (memcmp(footer->magic, APK_SIG_BLOCK_MAGIC, sizeof(footer->magic)))
+		return 0;
+
+	size = dtohll(footer->size);
+	if (size < sizeof(*footer) || size > cd_offset - sizeof(uint64_t)) {
+		error_set(err, ERROR_FORMAT, cd_offset - sizeof(*footer),
+			  "bad apk signing block size %llu",
+			  (unsigned long long)size);
+		return -1;
+	}
+	offset = cd_offset - size - sizeof(uint64_t);
+	memcpy(&leading_size, zip->map + offset, sizeof(leading_size));
+	if (dtohll(leading_size) != size) {
+		error_set(err, ERROR_FORMAT, offset,
+			  "apk signing block sizes differ: %llu != %llu",
+			  (unsigned long long)dtohll(leading_size),
+			  (unsigned long long)size);
+		return -1;
+	}
+	zip->signing_block_offset = offset;
+	zip->signing_block_size = size + sizeof(uint64_t);
+	return 0;
+}
+
+/*
+ * Find the zip64 EOCD locator, which must come right before the EOCD at
+ * eocd_offset in map, and store the offset of the zip64 EOCD it points to.
+ */
+static int read_zip64_locator(const uint8_t *map, size_t eocd_offset,
+			      uint64_t *eocd64_offset, struct error *err)
+{
+	const struct zip64_locator *locator;
+
+	if (eocd_offset < sizeof(*locator)) {
+		error_set(err, ERROR_FORMAT, eocd_offset,
+			  "missing zip64 eocd locator");
+		return -1;
+	}
+	locator = (const struct zip64_locator *)
+		(map + eocd_offset - sizeof(*locator));
+	if (dtohl(locator->magic) != ZIP64_LOCATOR_MAGIC) {
+		error_set(err, ERROR_FORMAT, eocd_offset - sizeof(*locator),
+			  "bad zip64 eocd locator magic 0x%08x",
+			  dtohl(locator->magic));
+		return -1;
+	}
+	*eocd64_offset = dtohll(locator->eocd_offset);
+	return 0;
+}
+
+static int read_zip64_eocd(const struct zip64_eocd *eocd64, uint64_t offset,
+			   uint64_t *entry_count, uint64_t *cd_offset,
+			   uint64_t *cd_size, struct error *err)
+{
+	if (dtohl(eocd64->magic) != ZIP64_EOCD_MAGIC) {
+		error_set(err, ERROR_FORMAT, offset,
+			  "bad zip64 eocd magic 0x%08x", dtohl(eocd64->magic));
+		return -1;
+	}
+	*entry_count = dtohll(eocd64->entry_count);
+	*cd_offset = dtohll(eocd64->cd_offset);
+	*cd_size = dtohll(eocd64->cd_size);
+	return 0;
+}
+
+/*
+ * Read the central directory location from the EOCD. Return 1 if the EOCD
+ * fields overflowed, and the location is in the zip64 EOCD instead.
+ */
+static int read_eocd(const struct zip_eocd *eocd, uint64_t *entry_count,
+		     uint64_t *cd_offset, uint64_t *cd_size)
+{
+	*entry_count = dtohs(eocd->entry_count);
+	*cd_offset = dtohl(eocd->cd_offset);
+	*cd_size = dtohl(eocd->cd_size);
+	return *entry_count == 0xffff || *cd_offset == 0xffffffff ||
+		*cd_size == 0xffffffff;
+}
+
+/*
+ * Read the central directory location from the EOCD, or from the zip64
+ * EOCD if the EOCD fields overflowed.
+ */
+static int read_cd_location(const uint8_t *map, size_t size,
+			    const struct zip_eocd *eocd, uint64_t *entry_count,
+			    uint64_t *cd_offset, uint64_t *cd_size,
+			    struct error *err)
+{
+	size_t eocd_offset = (const uint8_t *)eocd - map;
+	uint64_t eocd64_offset;
+
+	if (!read_eocd(eocd, entry_count, cd_offset, cd_size))
+		return 0;
+	if (read_zip64_locator(map, eocd_offset, &eocd64_offset, err))
+		return -1;
+	if (eocd64_offset > size - sizeof(struct zip64_eocd)) {
+		error_set(err, ERROR_FORMAT,
+			  eocd_offset - sizeof(struct zip64_locator),
+			  "zip64 eocd outside map");
+		return -1;
+	}
+	return read_zip64_eocd((const struct zip64_eocd *)
+			       (map + eocd64_offset), eocd64_offset,
+			       entry_count, cd_offset, cd_size, err);
+}
+
+/*
+ * Replace the CD fields that are all ones by their values in the zip64
+ * extra field, which holds them in this order, omitting the others.
+ */
+static int read_zip64_extra(const struct zip_cd *cd, const uint8_t *end,
+			    struct zip_entry *entry)
+{
+	const uint8_t *p = (const uint8_t *)cd->filename +
+		dtohs(cd->filename_length);
+	const uint8_t *extra_end = p + dtohs(cd->extra_length);
+	uint64_t *fields[3];
+	size_t i, n = 0;
+
+	if (entry->uncompressed_size == 0xffffffff)
+		fields[n++] = &entry->uncompressed_size;
+	if (entry->compressed_size == 0xffffffff)
+		fields[n++] = &entry->compressed_size;
+	if (entry->lfh_offset == 0xffffffff)
+		fields[n++] = &entry->lfh_offset;
+	if (n == 0)
+		return 0;
+
+	if (extra_end > end)
+		return -1;
+	while (p + sizeof(struct zip_extra) <= extra_end) {
+		const struct zip_extra *extra = (const struct zip_extra *)p;
+		uint16_t extra_size = dtohs(extra->size);
+
+		if (extra->data + extra_size > extra_end)
+			return -1;
+		if (dtohs(extra->id) == ZIP64_EXTRA_ID) {
+			if (extra_size < n * sizeof(uint64_t))
+				return -1;
+			for (i = 0; i < n; i++) {
+				uint64_t v;
+
+				memcpy(&v, extra->data + i * sizeof(v),
+				       sizeof(v));
+				*fields[i] = dtohll(v);
+			}
+			return 0;
+		}
+		p = extra->data + extra_size;
+	}
+	return -1;
+}
+
+static int read_cd(struct zip *zip, uint64_t cd_offset, struct error *err)
+{
+	const uint8_t *end = zip->map + zip->map_size;
+	const uint8_t *p;
+	size_t i;
+
+	if (cd_offset > zip->map_size) {
+		error_set(err, ERROR_FORMAT, 0, "cd offset too large");
+		return -1;
+	}
+	p = zip->map + cd_offset;
+	for (i = 0; i < zip->entry_count; i++) {
+		const struct zip_cd *cd = (const struct zip_cd *)p;
+		struct zip_entry *entry = &zip->entries[i];
+
+		if (p + sizeof(*cd) > end ||
+		    p + sizeof(*cd) + dtohs(cd->filename_length) > end) {
+			error_set(err, ERROR_FORMAT, p - zip->map,
+				  "cd outside map");
+			return -1;
+		}
+		if (dtohl(cd->magic) != ZIP_CD_MAGIC) {
+			error_set(err, ERROR_FORMAT, p - zip->map,
+				  "bad zip cd magic 0x%08x", dtohl(cd->magic));
+			return -1;
+		}
+
+		entry->name = cd->filename;
+		entry->name_length = dtohs(cd->filename_length);
+		entry->compression_method = dtohs(cd->compression_method);
+		entry->crc32 = dtohl(cd->crc32);
+		entry->compressed_size = dtohl(cd->compressed_size);
+		entry->uncompressed_size = dtohl(cd->uncompressed_size);
+		entry->lfh_offset = dtohl(cd->lfh_offset);
+		if (read_zip64_extra(cd, end, entry)) {
+			error_set(err, ERROR_FORMAT, p - zip->map,
+				  "bad zip64 extra field");
+			return -1;
+		}
+
+		p += sizeof(*cd) + entry->name_length +
+			dtohs(cd->extra_length) + dtohs(cd->comment_length);
+	}
+	return 0;
+}
+
+static void build_hash(struct zip *zip)
+{
+	size_t i;
+
+	for (i = 0; i < zip->entry_count; i++) {
+		const struct zip_entry *entry = &zip->entries[i];
+		uint32_t j = hash_name(entry->name, entry->name_length);
+
+		for (j &= zip->hash_mask; zip->hash[j];
+		     j = (j + 1) & zip->hash_mask)
+			;
+		zip->hash[j] = i + 1;
+	}
+}
+
+/*
+ * Read the entry_count records of the central directory at cd_offset in
+ * zip->map into zip->entries, and index them by name.
+ */
+static int load_cd(struct zip *zip, uint64_t entry_count, uint64_t cd_offset,
+		   struct error *err)
+{
+	uint32_t capacity = 16;
+
+	zip->entry_count = entry_count;
+	while (capacity < 2 * entry_count)
+		capacity *= 2;
+	zip->hash_mask = capacity - 1;
+	zip->entries = calloc(entry_count, sizeof(struct zip_entry));
+	zip->hash = calloc(capacity, sizeof(uint32_t));
+	if ((!zip->entries && entry_count) || !zip->hash) {
+		error_set(err, ERROR_NOMEM, 0, "out of memory");
+		zip_close(zip);
+		return -1;
+	}
+
+	if (read_cd(zip, cd_offset, err)) {
+		zip_close(zip);
+		return -1;
+	}
+	build_hash(zip);
+	return 0;
+}
+
+int zip_open(struct zip *zip, const void *map, size_t size,
+	     struct error *err)
+{
+	const struct zip_eocd *eocd;
+	uint64_t entry_count, cd_offset, cd_size;
+
+	zip->map = map;
+	zip->map_size = size;
+	zip->entries = NULL;
+	zip->hash = NULL;
+
+	eocd = find_eocd(map, size, err);
+	if (!eocd)
+		return -1;
+	if (read_cd_location(map, size, eocd, &entry_count, &cd_offset,
+			     &cd_size, err))
+		return -1;
+	/* the CD must end before the EOCD */
+	if (cd_offset > (size_t)((const uint8_t *)eocd - zip->map) ||
+	    cd_size > (const uint8_t *)eocd - zip->map - cd_offset) {
+		error_set(err, ERROR_FORMAT, (const uint8_t *)eocd - zip->map,
+			  "cd outside map");
+		return -1;
+	}
+	if (find_signing_block(zip, cd_offset, err))
+		return -1;
+	/* each CD record takes up at least sizeof(struct zip_cd) bytes */
+	if (entry_count > cd_size / sizeof(struct zip_cd)) {
+		error_set(err, ERROR_FORMAT, (const uint8_t *)eocd - zip->map,
+			  "bad entry count %llu",
+			  (unsigned long long)entry_count);
+		return -1;
+	}
+	return load_cd(zip, entry_count, cd_offset, err);
+}
+
+void zip_close(struct zip *zip)
+{
+	free(zip->entries);
+	free(zip->hash);
+	zip->entries = NULL;
+	zip->hash = NULL;
+}
+
+const struct zip_entry *zip_find(const struct zip *zip, const char *name)
+{
+	size_t len = strlen(name);
+	uint32_t j = hash_name(name, len) & zip->hash_mask;
+
+	for (; zip->hash[j]; j = (j + 1) & zip->hash_mask) {
+		const struct zip_entry *entry = &zip->entries[zip->hash[j] - 1];
+
+		if (entry->name_length == len &&
+		    !memcmp(entry->name, name, len))
+			return entry;
+	}
+	return NULL;
+}
+
+static int inflate_entry(const uint8_t *in, const struct zip_entry *entry,
+			 struct zip_buffer *buf, struct error *err)
+{
+	z_stream *zs = buf->stream;
+	uint64_t in_left = entry->compressed_size;
+	int ret;
+
+	if (entry->uncompressed_size > buf->capacity) {
+		void *data = realloc(buf->data, entry->uncompressed_size);
+
+		if (!data) {
+			error_set(err, ERROR_NOMEM, 0, "out of memory");
+			return -1;
+		}
+		buf->data = data;
+		buf->capacity = entry->uncompressed_size;
+	}
+
+	if (!zs) {
+		zs = calloc(1, sizeof(*zs));
+		/* negative window bits: raw deflate data, no zlib header */
+		if (!zs || inflateInit2(zs, -MAX_WBITS) != Z_OK) {
+			free(zs);
+			error_set(err, ERROR_NOMEM, 0, "out of memory");
+			return -1;
+		}
+		buf->stream = zs;
+	} else {
+		inflateReset(zs);
+	}
+
+	/* avail_in and avail_out are only 32 bits wide: feed in slices */
+	zs->next_out = buf->data;
+	zs->avail_out = 0;
+	zs->next_in = (Bytef *)in;
+	zs->avail_in = 0;
+	do {
+		uint64_t out_left = entry->uncompressed_size -
+			((uint8_t *)zs->next_out - (uint8_t *)buf->data);
+
+		if (zs->avail_in == 0) {
+			zs->avail_in = in_left > UINT32_MAX ? UINT32_MAX :
+				in_left;
+			in_left -= zs->avail_in;
+		}
+		if (zs->avail_out == 0)
+			zs->avail_out = out_left > UINT32_MAX ? UINT32_MAX :
+				out_left;
+		ret = inflate(zs, Z_NO_FLUSH);
+	} while (ret == Z_OK && (zs->avail_in > 0 || in_left > 0));
+
+	if (ret != Z_STREAM_END ||
+	    (uint8_t *)zs->next_out - (uint8_t *)buf->data !=
+	    (ptrdiff_t)entry->uncompressed_size) {
+		error_set(err, ERROR_FORMAT, entry->lfh_offset,
+			  "failed to inflate '%.*s'", entry->name_length,
+			  entry->name);
+		return -1;
+	}
+	if (crc32(0, buf->data, entry->uncompressed_size) != entry->crc32) {
+		error_set(err, ERROR_FORMAT, entry->lfh_offset,
+			  "crc mismatch in '%.*s'", entry->name_length,
+			  entry->name);
+		return -1;
+	}
+	return 0;
+}
+
+int zip_entry_data(const struct zip *zip, const struct zip_entry *entry,
+		   struct zip_buffer *buf, const void **data, size_t *size,
+		   struct error *err)
+{
+	const struct zip_lfh *lfh;
+	uint64_t offset;
+
+	if (zip->map_size < sizeof(*lfh) ||
+	    entry->lfh_offset > zip->map_size - sizeof(*lfh)) {
+		error_set(err, ERROR_FORMAT, entry->lfh_offset,
+			  "lfh offset outside map");
+		return -1;
+	}
+	lfh = (const struct zip_lfh *)(zip->map + entry->lfh_offset);
+	if (dtohl(lfh->magic) != ZIP_LFH_MAGIC) {
+		error_set(err, ERROR_FORMAT, entry->lfh_offset,
+			  "bad zip lfh magic 0x%08x", dtohl(lfh->magic));
+		return -1;
+	}
+	/* the lfh sizes are zero if a data descriptor is used: use the cd's */
+	offset = entry->lfh_offset + sizeof(*lfh) +
+		dtohs(lfh->filename_length) + dtohs(lfh->extra_length);
+	if (offset > zip->map_size ||
+	    entry->compressed_size > zip->map_size - offset) {
+		error_set(err, ERROR_FORMAT, offset,
+			  "zip entry '%.*s' outside map", entry->name_length,
+			  entry->name);
+		return -1;
+	}
+
+	switch (entry->compression_method) {
+	case ZIP_METHOD_STORED:
+		*data = zip->map + offset;
+		*size = entry->compressed_size;
+		return 0;
+	case ZIP_METHOD_DEFLATED:
+		if (inflate_entry(zip->map + offset, entry, buf, err))
+			return -1;
+		*data = buf->data;
+		*size = entry->uncompressed_size;
+		return 0;
+	default:
+		error_set(err, ERROR_UNSUPPORTED, entry->lfh_offset,
+			  "unhandled compression method %d",
+			  entry->compression_method);
+		return -1;
+	}
+}
+
+void zip_buffer_release(struct zip_buffer *buf)
+{
+	if (buf->stream) {
+		inflateEnd(buf->stream);
+		free(buf->stream);
+	}
+	free(buf->data);
+	buf->data = NULL;
+	buf->capacity = 0;
+	buf->stream = NULL;
+}
+
+static int pread_full(int fd, void *buf, size_t len, uint64_t offset,
+		      struct error *err)
+{
+	size_t done = 0;
+	ssize_t n;
+
+	while (done < len) {
+		n = pread(fd, (uint8_t *)buf + done, len - done,
+			  (off_t)(offset + done));
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0) {
+			error_set(err, ERROR_IO, offset + done, "pread");
+			return -1;
+		}
+		if (n == 0) {
+			error_set(err, ERROR_FORMAT, offset + done,
+				  "unexpected end of file");
+			return -1;
+		}
+		done += n;
+	}
+	return 0;
+}
+
+/*
+ * Find the central directory location with pread: the last 64 KiB hold the
+ * EOCD, its comment and the zip64 locator, if any, and are read in one go.
+ */
+static int pread_cd_location(int fd, uint64_t size, uint64_t *entry_count,
+			     uint64_t *cd_offset, uint64_t *cd_size,
+			     uint64_t *eocd_offset, struct error *err)
+{
+	size_t tail_size = sizeof(struct zip64_locator) +
+		sizeof(struct zip_eocd) + ZIP_MAX_COMMENT_LENGTH;
+	const struct zip_eocd *eocd;
+	struct zip64_eocd eocd64;
+	uint64_t tail_offset, eocd64_offset;
+	uint8_t *tail;
+	int ret = -1;
+
+	if (tail_size > size)
+		tail_size = size;
+	tail_offset = size - tail_size;
+	tail = malloc(tail_size + 1);
+	if (!tail) {
+		error_set(err, ERROR_NOMEM, 0, "out of memory");
+		return -1;
+	}
+	if (pread_full(fd, tail, tail_size, tail_offset, err))
+		goto out;
+	eocd = find_eocd(tail, tail_size, err);
+	if (!eocd) {
+		err->offset += tail_offset;
+		goto out;
+	}
+	*eocd_offset = tail_offset + ((const uint8_t *)eocd - tail);
+	if (!read_eocd(eocd, entry_count, cd_offset, cd_size)) {
+		ret = 0;
+		goto out;
+	}
+	if (read_zip64_locator(tail, (const uint8_t *)eocd - tail,
+			       &eocd64_offset, err)) {
+		err->offset += tail_offset;
+		goto out;
+	}
+	if (eocd64_offset > size - sizeof(eocd64)) {
+		error_set(err, ERROR_FORMAT,
+			  *eocd_offset - sizeof(struct zip64_locator),
+			  "zip64 eocd outside file");
+		goto out;
+	}
+	if (pread_full(fd, &eocd64, sizeof(eocd64), eocd64_offset, err))
+		goto out;
+	ret = read_zip64_eocd(&eocd64, eocd64_offset, entry_count, cd_offset,
+			      cd_size, err);
+out:
+	free(tail);
+	return ret;
+}
+
+int zip_locate_stored(int fd, uint64_t size, const char *name,
+		      uint64_t *offset, uint64_t *length, struct error *err)
+{
+	uint64_t entry_count, cd_offset, cd_size, eocd_offset, data;
+	const struct zip_entry *entry;
+	struct zip_lfh lfh;
+	struct zip zip;
+	uint8_t *cd;
+	int ret = -1;
+
+	if (pread_cd_location(fd, size, &entry_count, &cd_offset, &cd_size,
+			      &eocd_offset, err))
+		return -1;
+	/* the CD must end before the EOCD */
+	if (cd_offset > eocd_offset || cd_size > eocd_offset - cd_offset) {
+		error_set(err, ERROR_FORMAT, eocd_offset, "cd outside file");
+		return -1;
+	}
+	if (entry_count > cd_size / sizeof(struct zip_cd)) {
+		error_set(err, ERROR_FORMAT, eocd_offset,
+			  "bad entry count %llu",
+			  (unsigned long long)entry_count);
+		return -1;
+	}
+
+	/* only the CD is held in memory, and parsed as zip_open does */
+	cd = malloc(cd_size + 1);
+	if (!cd) {
+		error_set(err, ERROR_NOMEM, 0, "out of memory");
+		return -1;
+	}
+	if (pread_full(fd, cd, cd_size, cd_offset, err))
+		goto out;
+	zip.map = cd;
+	zip.map_size = cd_size;
+	zip.signing_block_offset = 0;
+	zip.signing_block_size = 0;
+	if (load_cd(&zip, entry_count, 0, err)) {
+		err->offset += cd_offset;
+		goto out;
+	}
+
+	entry = zip_find(&zip, name);
+	if (!entry) {
+		error_set(err, ERROR_FORMAT, 0, "no entry '%s' found", name);
+		goto close;
+	}
+	if (entry->compression_method != ZIP_METHOD_STORED) {
+		error_set(err, ERROR_UNSUPPORTED, entry->lfh_offset,
+			  "entry '%s' is compressed (method %d)", name,
+			  entry->compression_method);
+		goto close;
+	}
+	/* entries come before the CD */
+	if (entry->lfh_offset > cd_offset ||
+	    cd_offset - entry->lfh_offset < sizeof(lfh)) {
+		error_set(err, ERROR_FORMAT, entry->lfh_offset,
+			  "lfh offset outside file");
+		goto close;
+	}
+	if (pread_full(fd, &lfh, sizeof(lfh), entry->lfh_offset, err))
+		goto close;
+	if (dtohl(lfh.magic) != ZIP_LFH_MAGIC) {
+		error_set(err, ERROR_FORMAT, entry->lfh_offset,
+			  "bad zip lfh magic 0x%08x", dtohl(lfh.magic));
+		goto close;
+	}
+	/* the lfh sizes are zero if a data descriptor is used: use the cd's */
+	data = entry->lfh_offset + sizeof(lfh) +
+		dtohs(lfh.filename_length) + dtohs(lfh.extra_length);
+	if (data > cd_offset || entry->compressed_size > cd_offset - data) {
+		error_set(err, ERROR_FORMAT, data,
+			  "zip entry '%s' outside file", name);
+		goto close;
+	}
+	*offset = data;
+	*length = entry->compressed_size;
+	ret = 0;
+close:
+	zip_close(&zip);
+out:
+	free(cd);
+	return ret;
+}
@@ -0,0 +1,90 @@
+#ifndef ARSC_ZIP_H
+#define ARSC_ZIP_H
+#include <stddef.h>
+#include <stdint.h>
+
+struct error;
+
+/*
+ * Read-only zip (apk) reader operating on a memory mapped archive.
+ *
+ * zip_open reads the central directory once, and builds a hash table from
+ * entry names so that zip_find is O(1). Entry data is returned as a pointer
+ * into the map for stored entries, and inflated into a caller owned,
+ * reusable zip_buffer for deflated entries.
+ */
+struct zip_entry {
+	const char *name; /* points into the map; not NUL terminated */
+	uint16_t name_length;
+	uint16_t compression_method;
+	uint32_t crc32;
+	uint64_t compressed_size;
+	uint64_t uncompressed_size;
+	uint64_t lfh_offset;
+};
+
+struct zip {
+	const uint8_t *map;
+	size_t map_size;
+	struct zip_entry *entries;
+	size_t entry_count;
+	uint32_t *hash; /* entry index + 1; 0 means empty */
+	uint32_t hash_mask;
+
+	/* APK Signing Block, if any (size 0 otherwise) */
+	uint64_t signing_block_offset;
+	uint64_t signing_block_size;
+};
+
+/*
+ * Output buffer for inflated entries. Initialize with ZIP_BUFFER_INIT;
+ * the buffer and the inflate state are reused between calls to
+ * zip_entry_data, and released by zip_buffer_release.
+ */
+struct zip_buffer {
+	void *data;
+	size_t capacity;
+	void *stream;
+};
+
+#define ZIP_BUFFER_INIT { NULL, 0, NULL }
+
+#define ZIP_METHOD_STORED 0
+#define ZIP_METHOD_DEFLATED 8
+
+/*
+ * Return non-zero if map looks like a zip file.
+ */
+int zip_is_zip(const void *map, size_t size);
+
+int zip_open(struct zip *zip, const void *map, size_t size,
+	     struct error *err);
+void zip_close(struct zip *zip);
+
+/*
+ * Find an entry by name. Return NULL if there is no such entry.
+ */
+const struct zip_entry *zip_find(const struct zip *zip, const char *name);
+
+/*
+ * Retrieve the uncompressed contents of entry. For stored entries *data
+ * points into the map and buf is not touched; for deflated entries *data
+ * points into buf, and stays valid until buf is reused or released.
+ */
+int zip_entry_data(const struct zip *zip, const struct zip_entry *entry,
+		   struct zip_buffer *buf, const void **data, size_t *size,
+		   struct error *err);
+
+void zip_buffer_release(struct zip_buffer *buf);
+
+/*
+ * Find the entry called name in the zip archive of size bytes open as fd,
+ * without mapping it: the EOCD, the central directory and the entry's
+ * local header are read with pread. Store the offset and size of the
+ * entry's data within the archive in *offset and *length. Only stored
+ * entries can be used in place; compressed ones are ERROR_UNSUPPORTED.
+ */
+int zip_locate_stored(int fd, uint64_t size, const char *name,
+		      uint64_t *offset, uint64_t *length, struct error *err);
+
+#endif